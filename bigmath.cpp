@@ -1,7 +1,38 @@
 #include "bigmath.h"
 #include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <system_error>
+#include <exception>
 
-BigUnsigned::Data * BigUnsigned::smallNumbers = NULL;
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BIGMATH_X86_INTRINSICS
+#include <immintrin.h>
+// vectorized kernels are compiled for every x86-64 target and picked at run time; define BIGMATH_NO_SIMD to leave them out
+#ifndef BIGMATH_NO_SIMD
+#define BIGMATH_SIMD_KERNELS
+#endif
+#endif
+
+BigUnsigned::Data * BigUnsigned::makeSmallNumbers()
+{
+    if(smallNumbers) // already set up by a BigUnsigned made during static initialization
+        return smallNumbers;
+    Data * retval = new Data[SmallNumberCount];
+    for(WordType i = 0; i < SmallNumberCount; i++)
+    {
+        retval[i].words[0] = i;
+        retval[i].refCount = Data::SharedRefCount;
+    }
+    return retval;
+}
+
+// set up before main() rather than on first use, so threads started later don't race to do it
+BigUnsigned::Data * BigUnsigned::smallNumbers = BigUnsigned::makeSmallNumbers();
 
 static inline void addWithCarry(WordType a, WordType b, bool carryIn, WordType & result, bool & carryOut)
 {
@@ -22,6 +53,30 @@ static inline void subtractWithBorrow(WordType a, WordType b, bool borrowIn, Wor
     result = (WordType)(v & WordMax);
 }
 
+// addcarry/subborrow keep the carry in the flags register along a chain of words; with bool carries the compiler rebuilds it for every word
+// 64-bit words can't use _addcarry_u64 here (see addWords)
+static inline unsigned char addWordsCarry(unsigned char carry, WordType a, WordType b, WordType & result)
+{
+#if defined(BIGMATH_X86_INTRINSICS) && !defined(BIGMATH_64BIT_WORDS)
+    return _addcarry_u32(carry, a, b, &result);
+#else
+    bool carryOut;
+    addWithCarry(a, b, carry != 0, result, carryOut);
+    return carryOut;
+#endif
+}
+
+static inline unsigned char subtractWordsBorrow(unsigned char borrow, WordType a, WordType b, WordType & result)
+{
+#if defined(BIGMATH_X86_INTRINSICS) && !defined(BIGMATH_64BIT_WORDS)
+    return _subborrow_u32(borrow, a, b, &result);
+#else
+    bool borrowOut;
+    subtractWithBorrow(a, b, borrow != 0, result, borrowOut);
+    return borrowOut;
+#endif
+}
+
 static inline void multiplyDoubleWord(WordType a, WordType b, WordType & highWord, WordType & lowWord)
 {
     DoubleWordType v = a;
@@ -49,13 +104,48 @@ static inline void multiplyDoubleWordAndAddTwo(WordType a, WordType b, WordType
     lowWord = (WordType)(v & WordMax);
 }
 
-static inline void divideDoubleWord(WordType dividendHighWord, WordType dividendLowWord, WordType divisor, WordType & quotient, WordType & remainder)
+static inline void divideDoubleWord(WordType dividendHighWord, WordType dividendLowWord, WordType divisor, WordType & quotient, WordType & remainder) // requires dividendHighWord < divisor
 {
+#if defined(BIGMATH_64BIT_WORDS) && defined(__x86_64__)
+    // the compiler would call a 128-bit division routine; the quotient fits in a word so divq does it directly
+    __asm__("divq %4" : "=a"(quotient), "=d"(remainder) : "a"(dividendLowWord), "d"(dividendHighWord), "rm"(divisor) : "cc");
+#else
     DoubleWordType dividend = dividendHighWord;
     dividend <<= BitsPerWord;
     dividend |= dividendLowWord;
     quotient = (WordType)(dividend / divisor);
     remainder = (WordType)(dividend % divisor);
+#endif
+}
+
+/* Möller and Granlund, "Improved division by invariant integers".  A normalized (top bit set) divisor d gets the
+ * reciprocal v = floor((W^2 - 1) / d) - W once; after that each quotient word costs two multiplications instead of a
+ * hardware division.  divide() keeps the hardware division for its quotient estimates: there the subtraction of
+ * qhat times the divisor dominates, and the 3/2 form of this measured slower than divq.
+ */
+static inline WordType reciprocalWord(WordType divisor) // requires a normalized divisor
+{
+    WordType quotient, remainder;
+    divideDoubleWord(~divisor, WordMax, divisor, quotient, remainder);
+    return quotient;
+}
+
+static inline void divideDoubleWordPreinverted(WordType dividendHighWord, WordType dividendLowWord, WordType divisor, WordType reciprocal, WordType & quotient, WordType & remainder) // requires dividendHighWord < divisor, a normalized divisor and reciprocal = reciprocalWord(divisor)
+{
+    DoubleWordType q = (DoubleWordType)dividendHighWord * reciprocal;
+    q += ((DoubleWordType)(dividendHighWord + 1) << BitsPerWord) | dividendLowWord;
+    WordType quotientHigh = (WordType)(q >> BitsPerWord), quotientLow = (WordType)q;
+    WordType r = dividendLowWord - quotientHigh * divisor;
+    WordType mask = -(WordType)(r > quotientLow); // the estimate is one too big about half the time, so this doesn't branch
+    quotientHigh += mask;
+    r += mask & divisor;
+    if(r >= divisor)
+    {
+        r -= divisor;
+        quotientHigh++;
+    }
+    quotient = quotientHigh;
+    remainder = r;
 }
 
 static inline void lshiftDoubleWord(WordType highWordIn, WordType lowWordIn, size_t shiftCount, WordType & highWordOut)
@@ -194,7 +284,7 @@ BigUnsigned BigUnsigned::fromByteString(string str)
     retval.data->words[wordPos] |= ((WordType)currentByte << (8 * (bytePos % BytesPerWord)));
     for(size_t i = 0; i < str.size(); i++)
     {
-        unsigned currentByte = str[i];
+        unsigned currentByte = (unsigned char)str[i];
         size_t bytePos = byteCount - ++byteNumber;
         size_t wordPos = bytePos / BytesPerWord;
         retval.data->words[wordPos] |= ((WordType)currentByte << (8 * (bytePos % BytesPerWord)));
@@ -221,23 +311,17 @@ string BigUnsigned::toByteString() const
     return retval;
 }
 
+static bool addWords(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize);
+static bool subtractWords(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize);
+
 const BigUnsigned & BigUnsigned::operator +=(BigUnsigned b)
 {
     if(b.data->size == 1)
         return operator +=(b.data->words[0]);
     onWrite();
-    size_t size = max(data->size, b.data->size) + 1;
-    data->expand(size);
-    bool carry = false;
-    for(size_t i = 0; i < size; i++)
-    {
-        WordType bWord = 0;
-        if(i < b.data->size)
-            bWord = b.data->words[i];
-        else if(!carry)
-            break;
-        addWithCarry(data->words[i], bWord, carry, data->words[i], carry);
-    }
+    size_t size = max(data->size, b.data->size);
+    data->expand(size + 1);
+    data->words[size] = addWords(data->words, data->words, size, b.data->words, b.data->size) ? 1 : 0;
     normalize();
     return *this;
 }
@@ -264,20 +348,7 @@ const BigUnsigned & BigUnsigned::operator -=(BigUnsigned b)
     onWrite();
     if(*this < b)
         handleError("subtraction has negative result in BigUnsigned::operator -=");
-    bool borrow = false;
-    size_t i;
-    for(i = 0; i < b.data->size; i++)
-    {
-        subtractWithBorrow(data->words[i], b.data->words[i], borrow, data->words[i], borrow);
-    }
-    if(borrow)
-    {
-        for(; i < data->size; i++)
-        {
-            if(data->words[i]-- != 0)
-                break;
-        }
-    }
+    subtractWords(data->words, data->words, data->size, b.data->words, b.data->size);
     normalize();
     return *this;
 }
@@ -331,317 +402,3226 @@ BigUnsigned operator *(BigUnsigned a, WordType b)
     return a;
 }
 
-BigUnsigned operator *(BigUnsigned a, BigUnsigned b)
+static int compareWords(const WordType a[], size_t aSize, const WordType b[], size_t bSize)
 {
-    if(a.data->size < b.data->size)
-        swap(a, b);
-    if(b.data->size == 1)
-        return operator *(a, b.data->words[0]);
-    BigUnsigned retval(0, a.data->size + b.data->size);
-    WordType carry = 0;
-    for(size_t i = 0; i < a.data->size; i++)
+    while(aSize > bSize)
     {
-        multiplyDoubleWordAndAdd(a.data->words[i], b.data->words[0], carry, carry, retval.data->words[i]);
+        if(a[--aSize] != 0)
+            return 1;
     }
-    retval.data->words[a.data->size] = carry;
-    for(size_t i = 1; i < b.data->size; i++)
+    while(bSize > aSize)
     {
-        carry = 0;
-        for(size_t j = 0; j < a.data->size; j++)
-        {
-            multiplyDoubleWordAndAddTwo(a.data->words[j], b.data->words[i], carry, retval.data->words[i + j], carry, retval.data->words[i + j]);
-        }
-        retval.data->words[i + a.data->size] = carry;
+        if(b[--bSize] != 0)
+            return -1;
     }
-    retval.normalize();
-    return retval;
+    for(size_t i = 0, j = aSize - 1; i < aSize; i++, j--)
+    {
+        if(a[j] > b[j])
+            return 1;
+        if(a[j] < b[j])
+            return -1;
+    }
+    return 0;
 }
 
-static void divMod(WordType dividend, WordType divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+static bool addWords(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize) // requires aSize >= bSize; returns carry out of dest[aSize - 1]
 {
-    if(divisor == 0)
-        handleError("division by 0 in BigUnsigned::divMod");
-    if(pquotient)
-        *pquotient = dividend / divisor;
-    if(premainder)
-        *premainder = dividend % divisor;
+    unsigned char carry = 0;
+    size_t i = 0;
+#if defined(BIGMATH_X86_INTRINSICS) && defined(BIGMATH_64BIT_WORDS)
+    // _addcarry_u64 only writes through unsigned long long *, which may not alias our uint64_t words, and going through a local makes GCC spill every word; this is the same adc chain
+    if(bSize >= 4)
+    {
+        size_t count = bSize / 4;
+        WordType t0, t1;
+        __asm__("clc\n"
+                "1:\n\t"
+                "movq (%[a],%[i],8), %[t0]\n\t"
+                "movq 8(%[a],%[i],8), %[t1]\n\t"
+                "adcq (%[b],%[i],8), %[t0]\n\t"
+                "adcq 8(%[b],%[i],8), %[t1]\n\t"
+                "movq %[t0], (%[d],%[i],8)\n\t"
+                "movq %[t1], 8(%[d],%[i],8)\n\t"
+                "movq 16(%[a],%[i],8), %[t0]\n\t"
+                "movq 24(%[a],%[i],8), %[t1]\n\t"
+                "adcq 16(%[b],%[i],8), %[t0]\n\t"
+                "adcq 24(%[b],%[i],8), %[t1]\n\t"
+                "movq %[t0], 16(%[d],%[i],8)\n\t"
+                "movq %[t1], 24(%[d],%[i],8)\n\t"
+                "leaq 4(%[i]), %[i]\n\t"
+                "decq %[count]\n\t"
+                "jnz 1b\n\t"
+                "setc %[carry]"
+                : [carry] "=r"(carry), [i] "+r"(i), [count] "+r"(count), [t0] "=&r"(t0), [t1] "=&r"(t1)
+                : [a] "r"(a), [b] "r"(b), [d] "r"(dest)
+                : "cc", "memory");
+    }
+#else
+    for(; i + 4 <= bSize; i += 4)
+    {
+        carry = addWordsCarry(carry, a[i], b[i], dest[i]);
+        carry = addWordsCarry(carry, a[i + 1], b[i + 1], dest[i + 1]);
+        carry = addWordsCarry(carry, a[i + 2], b[i + 2], dest[i + 2]);
+        carry = addWordsCarry(carry, a[i + 3], b[i + 3], dest[i + 3]);
+    }
+#endif
+    for(; i < bSize; i++)
+    {
+        carry = addWordsCarry(carry, a[i], b[i], dest[i]);
+    }
+    for(; carry && i < aSize; i++)
+    {
+        carry = addWordsCarry(carry, a[i], 0, dest[i]);
+    }
+    if(dest != a)
+    {
+        for(; i < aSize; i++)
+            dest[i] = a[i];
+    }
+    return carry;
 }
 
-static void lshiftWords(WordType dest[], WordType src[], size_t size, size_t shiftCount) // either src == dest or they aren't overlapping
+static bool subtractWords(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize) // requires aSize >= bSize; returns borrow out of dest[aSize - 1]
 {
-    if(shiftCount == 0)
+    unsigned char borrow = 0;
+    size_t i = 0;
+#if defined(BIGMATH_X86_INTRINSICS) && defined(BIGMATH_64BIT_WORDS)
+    if(bSize >= 4) // see addWords
     {
-        if(dest == src)
-            return;
-        for(size_t i = 0; i < size; i++)
-            dest[i] = src[i];
-        return;
+        size_t count = bSize / 4;
+        WordType t0, t1;
+        __asm__("clc\n"
+                "1:\n\t"
+                "movq (%[a],%[i],8), %[t0]\n\t"
+                "movq 8(%[a],%[i],8), %[t1]\n\t"
+                "sbbq (%[b],%[i],8), %[t0]\n\t"
+                "sbbq 8(%[b],%[i],8), %[t1]\n\t"
+                "movq %[t0], (%[d],%[i],8)\n\t"
+                "movq %[t1], 8(%[d],%[i],8)\n\t"
+                "movq 16(%[a],%[i],8), %[t0]\n\t"
+                "movq 24(%[a],%[i],8), %[t1]\n\t"
+                "sbbq 16(%[b],%[i],8), %[t0]\n\t"
+                "sbbq 24(%[b],%[i],8), %[t1]\n\t"
+                "movq %[t0], 16(%[d],%[i],8)\n\t"
+                "movq %[t1], 24(%[d],%[i],8)\n\t"
+                "leaq 4(%[i]), %[i]\n\t"
+                "decq %[count]\n\t"
+                "jnz 1b\n\t"
+                "setc %[borrow]"
+                : [borrow] "=r"(borrow), [i] "+r"(i), [count] "+r"(count), [t0] "=&r"(t0), [t1] "=&r"(t1)
+                : [a] "r"(a), [b] "r"(b), [d] "r"(dest)
+                : "cc", "memory");
     }
-    WordType lastWord = 0;
-    for(size_t i = 0; i < size; i++)
+#else
+    for(; i + 4 <= bSize; i += 4)
+    {
+        borrow = subtractWordsBorrow(borrow, a[i], b[i], dest[i]);
+        borrow = subtractWordsBorrow(borrow, a[i + 1], b[i + 1], dest[i + 1]);
+        borrow = subtractWordsBorrow(borrow, a[i + 2], b[i + 2], dest[i + 2]);
+        borrow = subtractWordsBorrow(borrow, a[i + 3], b[i + 3], dest[i + 3]);
+    }
+#endif
+    for(; i < bSize; i++)
     {
-        WordType word = src[i];
-        lshiftDoubleWord(word, lastWord, shiftCount, dest[i]);
-        lastWord = word;
+        borrow = subtractWordsBorrow(borrow, a[i], b[i], dest[i]);
     }
+    for(; borrow && i < aSize; i++)
+    {
+        borrow = subtractWordsBorrow(borrow, a[i], 0, dest[i]);
+    }
+    if(dest != a)
+    {
+        for(; i < aSize; i++)
+            dest[i] = a[i];
+    }
+    return borrow;
 }
 
-static void rshiftWords(WordType dest[], WordType src[], size_t size, size_t shiftCount) // either src == dest or they aren't overlapping
+static bool subtractWordsAbsolute(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize) // dest = |a - b| padded to max(aSize, bSize) words; returns true if a < b
 {
-    if(shiftCount == 0)
+    if(compareWords(a, aSize, b, bSize) < 0)
     {
-        if(dest == src)
-            return;
-        for(size_t i = 0; i < size; i++)
-            dest[i] = src[i];
-        return;
+        subtractWords(dest, b, bSize, a, min(aSize, bSize));
+        for(size_t i = bSize; i < aSize; i++)
+            dest[i] = 0;
+        return true;
     }
-    WordType lastWord = 0;
-    for(size_t i = 0, j = size - 1; i < size; i++, j--)
+    subtractWords(dest, a, aSize, b, min(aSize, bSize));
+    for(size_t i = aSize; i < bSize; i++)
+        dest[i] = 0;
+    return false;
+}
+
+#ifdef BIGMATH_SIMD_KERNELS
+// the carry-free linear operations work on 256 bits at a time when the CPU has AVX2
+static const size_t Avx2WordsPerVector = 32 / BytesPerWord;
+
+static const size_t Avx2ShiftThreshold = 4 * Avx2WordsPerVector; // shorter shifts lose more to the extra load and vector setup than they gain
+
+static bool hasAvx2() // checks the CPU on first use
+{
+    static const bool retval = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+    return retval;
+}
+#endif
+
+enum BitwiseOperation
+{
+    BitwiseXor,
+    BitwiseOr,
+    BitwiseAnd,
+};
+
+#ifdef BIGMATH_SIMD_KERNELS
+__attribute__((target("avx2"))) static size_t bitwiseWordsAvx2(WordType dest[], const WordType src[], size_t size, BitwiseOperation operation) // returns how many words were done
+{
+    size_t i = 0;
+    for(; i + Avx2WordsPerVector <= size; i += Avx2WordsPerVector)
     {
-        WordType word = src[j];
-        rshiftDoubleWord(lastWord, word, shiftCount, dest[j]);
-        lastWord = word;
+        __m256i x = _mm256_loadu_si256((const __m256i *)(dest + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(src + i));
+        if(operation == BitwiseXor)
+            x = _mm256_xor_si256(x, y);
+        else if(operation == BitwiseOr)
+            x = _mm256_or_si256(x, y);
+        else
+            x = _mm256_and_si256(x, y);
+        _mm256_storeu_si256((__m256i *)(dest + i), x);
     }
+    return i;
 }
+#endif
 
-static size_t countLeadingZeros(WordType v)
+static void bitwiseWords(WordType dest[], const WordType src[], size_t size, BitwiseOperation operation) // dest[0:size-1] op= src[0:size-1]
 {
-    size_t retval = 0;
-    while((v & ((WordType)1 << (BitsPerWord - 1))) == 0)
+    size_t i = 0;
+#ifdef BIGMATH_SIMD_KERNELS
+    if(size >= Avx2WordsPerVector && hasAvx2())
+        i = bitwiseWordsAvx2(dest, src, size, operation);
+#endif
+    for(; i < size; i++)
     {
-        retval++;
-        v <<= 1;
+        if(operation == BitwiseXor)
+            dest[i] ^= src[i];
+        else if(operation == BitwiseOr)
+            dest[i] |= src[i];
+        else
+            dest[i] &= src[i];
     }
-    return retval;
 }
 
-  /* Subtract x[0:len-1]*y from dest[offset:offset+len-1]. from http://www.opensource.apple.com/source/gcc/gcc-5484/libjava/gnu/java/math/MPN.java
-   * All values are treated as if unsigned.
-   * @return the most significant word of
-   * the product, minus borrow-out from the subtraction.
-   */
-static WordType submul_1(WordType dest[], size_t offset, const WordType x[], size_t len, WordType y)
+static WordType addmul_1(WordType dest[], const WordType x[], size_t len, WordType y) // dest[0:len-1] += x[0:len-1] * y; returns the carry word
 {
     WordType carry = 0;
-    size_t j = 0;
-    do
+    for(size_t j = 0; j < len; j++)
     {
-        WordType prod_low;
-        multiplyDoubleWordAndAdd(y, x[j], carry, carry, prod_low);
-        WordType x_j = dest[offset + j];
-        prod_low = x_j - prod_low;
-        if (prod_low > x_j)
-            carry++;
-        dest[offset + j] = prod_low;
+        multiplyDoubleWordAndAddTwo(x[j], y, carry, dest[j], carry, dest[j]);
     }
-    while (++j < len);
     return carry;
 }
 
+static WordType submul_1(WordType dest[], size_t offset, const WordType x[], size_t len, WordType y);
 
- /** Divide zds[0:nx] by y[0:ny-1]. from http://www.opensource.apple.com/source/gcc/gcc-5484/libjava/gnu/java/math/MPN.java
-   * The remainder ends up in zds[0:ny-1].
-   * The quotient ends up in zds[ny:nx].
-   * Assumes:  nx>ny.
-   * (int)y[ny-1] < 0  (i.e. most significant bit set)
-   */
+static void addmulWords(WordType dest[], size_t destSize, const WordType x[], size_t xSize, WordType y) // dest += x * y; the result must fit in destSize words
+{
+    WordType carry = addmul_1(dest, x, xSize, y);
+    if(xSize < destSize)
+        addWords(dest + xSize, dest + xSize, destSize - xSize, &carry, 1);
+}
 
-static void divide(WordType zds[], size_t nx, const WordType y[], size_t ny)
+static void submulWords(WordType dest[], size_t destSize, const WordType x[], size_t xSize, WordType y) // dest -= x * y; the result must not be negative
 {
-    // This is basically Knuth's formulation of the classical algorithm,
-    // but translated from in scm_divbigbig in Jaffar's SCM implementation.
+    WordType borrow = submul_1(dest, 0, x, xSize, y);
+    if(xSize < destSize)
+        subtractWords(dest + xSize, dest + xSize, destSize - xSize, &borrow, 1);
+}
 
-    // Correspondance with Knuth's notation:
-    // Knuth's u[0:m+n] == zds[nx:0].
-    // Knuth's v[1:n] == y[ny-1:0]
-    // Knuth's n == ny.
-    // Knuth's m == nx-ny.
-    // Our nx == Knuth's m+n.
+static void addWordsAt(WordType dest[], size_t destSize, size_t offset, const WordType src[], size_t srcSize) // dest += src * W^offset; src words past the end of dest must be 0
+{
+    addWords(dest + offset, dest + offset, destSize - offset, src, min(srcSize, destSize - offset));
+}
 
-    // Could be re-implemented using gmp's mpn_divrem:
-    // zds[nx] = mpn_divrem (&zds[ny], 0, zds, nx, y, ny).
+static WordType divideWordsByWord(WordType dest[], const WordType src[], size_t size, WordType divisor) // returns the remainder; dest may be src
+{
+    WordType remainder = 0;
+    for(size_t i = 0, j = size - 1; i < size; i++, j--)
+    {
+        divideDoubleWord(remainder, src[j], divisor, dest[j], remainder);
+    }
+    return remainder;
+}
 
-    size_t j = nx;
-    do
-    {                          // loop over digits of quotient
-        // Knuth's j == our nx-j.
-        // Knuth's u[j:j+n] == our zds[j:j-ny].
-        WordType qhat;
-        if(zds[j] == y[ny - 1])
-            qhat = WordMax;
-        else
+static WordType divideWordsByWordPreinverted(WordType dest[], const WordType src[], size_t size, WordType divisor, size_t shiftCount, WordType reciprocal) // divisor is the real one << shiftCount, normalized, and src is shifted to match on the fly; returns the real remainder; dest may be src or NULL
+{
+    WordType remainder = 0, quotient;
+    if(shiftCount != 0)
+        remainder = src[size - 1] >> (BitsPerWord - shiftCount);
+    for(size_t j = size; j-- > 0;)
+    {
+        WordType word = src[j] << shiftCount;
+        if(shiftCount != 0 && j > 0)
+            word |= src[j - 1] >> (BitsPerWord - shiftCount);
+        divideDoubleWordPreinverted(remainder, word, divisor, reciprocal, quotient, remainder);
+        if(dest)
+            dest[j] = quotient;
+    }
+    return remainder >> shiftCount;
+}
+
+static void lshiftWords(WordType dest[], WordType src[], size_t size, size_t shiftCount); // dest may be src or above it
+static void rshiftWords(WordType dest[], WordType src[], size_t size, size_t shiftCount); // dest may be src or below it
+
+static void multiplyWords(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize);
+
+#ifdef BIGMATH_SIMD_KERNELS
+/* Vectorized schoolbook multiplication.
+ *
+ * A row a * b[i] can't be vectorized directly because every word waits on the carry out of the word below it.
+ * Instead both operands are split into digits narrower than 64 bits, so a whole column of digit products can be
+ * summed in a 64-bit lane without overflowing.  Each vector holds the sums for a few neighbouring columns, the rows
+ * are added into it with no carries at all, and the carries are resolved once when the digits are packed back into
+ * words.
+ *
+ * With AVX-512 IFMA the digits are 52 bits and vpmadd52luq/vpmadd52huq add the low and high halves of each
+ * 104-bit product into two accumulators.  Without it the digits are 28 bits and vpmuludq products are added whole;
+ * a 64-bit lane then has room for 256 of them, more than the digits in SimdMaxOperandBits.  Those kernels only pay
+ * off with 32-bit words.
+ */
+enum SimdKernel
+{
+    SimdNone,
+    SimdAvx2,
+    SimdAvx512,
+    SimdAvx512Ifma,
+};
+
+static const size_t SimdMaxOperandBits = 4096; // longer operands are split into pieces of this size; up to here schoolbook beats Karatsuba
+static const size_t SimdMaxDigits = SimdMaxOperandBits / 28 + 1;
+static const size_t SimdColumnCount = 2 * SimdMaxDigits + 8;
+
+__extension__ typedef unsigned __int128 SimdBitBuffer; // holds a partial word plus a partial digit
+
+struct SimdSchoolbook
+{
+    SimdKernel kernel;
+    size_t threshold; // shorter operands, in words, aren't worth converting to digits
+};
+
+static SimdSchoolbook selectSimdSchoolbook()
+{
+    SimdSchoolbook retval = {SimdNone, 0};
+    __builtin_cpu_init();
+#ifdef BIGMATH_64BIT_WORDS
+    // 28-bit digits need five products for every product of 64-bit words, which the vectors don't make up for
+    if(__builtin_cpu_supports("avx512ifma"))
+        retval.kernel = SimdAvx512Ifma, retval.threshold = 16;
+#else
+    if(__builtin_cpu_supports("avx512ifma"))
+        retval.kernel = SimdAvx512Ifma, retval.threshold = 12;
+    else if(__builtin_cpu_supports("avx512f"))
+        retval.kernel = SimdAvx512, retval.threshold = 16;
+    else if(__builtin_cpu_supports("avx2"))
+        retval.kernel = SimdAvx2, retval.threshold = 20;
+#endif
+    return retval;
+}
+
+static const SimdSchoolbook & simdSchoolbook() // checks the CPU on first use
+{
+    static const SimdSchoolbook retval = selectSimdSchoolbook();
+    return retval;
+}
+
+static bool useSimdSchoolbook(size_t bSize) // for the shorter operand of a product
+{
+    const SimdSchoolbook & simd = simdSchoolbook();
+    return simd.kernel != SimdNone && bSize >= simd.threshold && bSize <= SimdMaxOperandBits / BitsPerWord;
+}
+
+static size_t unpackDigits(uint64_t digits[], const WordType src[], size_t size, unsigned digitBits) // returns the digit count
+{
+    const uint64_t digitMask = ((uint64_t)1 << digitBits) - 1;
+    SimdBitBuffer buffer = 0;
+    unsigned bufferBits = 0;
+    size_t digitCount = 0;
+    for(size_t i = 0; i < size; i++)
+    {
+        buffer |= (SimdBitBuffer)src[i] << bufferBits;
+        bufferBits += BitsPerWord;
+        while(bufferBits >= digitBits)
         {
-            WordType remainder;
-            divideDoubleWord(zds[j], zds[j - 1], y[ny - 1], qhat, remainder);
+            digits[digitCount++] = (uint64_t)buffer & digitMask;
+            buffer >>= digitBits;
+            bufferBits -= digitBits;
         }
-        if(qhat != 0)
+    }
+    if(bufferBits > 0)
+        digits[digitCount++] = (uint64_t)buffer;
+    return digitCount;
+}
+
+static void packColumns(WordType dest[], size_t size, const uint64_t low[], const uint64_t high[], unsigned digitBits) // resolves the column carries; high[c] belongs to column c + 1
+{
+    const uint64_t digitMask = ((uint64_t)1 << digitBits) - 1;
+    SimdBitBuffer buffer = 0;
+    unsigned bufferBits = 0;
+    uint64_t carry = 0;
+    size_t column = 0;
+    for(size_t i = 0; i < size; i++)
+    {
+        while(bufferBits < BitsPerWord)
         {
-            WordType borrow = submul_1(zds, j - ny, y, ny, qhat);
-            WordType save = zds[j];
-            if(save != borrow)
+            uint64_t v = low[column] + carry;
+            carry = v >> digitBits;
+            if(high != NULL)
             {
-                bool carry;
-                do
-                {
-                    qhat--;
-                    carry = false;
-                    for (size_t i = 0; i < ny; i++)
-                    {
-                        addWithCarry(zds[j - ny + i], y[i], carry, zds[j - ny + i], carry);
-                    }
-                    if(carry)
-                        zds[j]++;
-                }
-                while(!carry);
+                v = (v & digitMask) + (column > 0 ? high[column - 1] : 0);
+                carry += v >> digitBits;
             }
+            buffer |= (SimdBitBuffer)(v & digitMask) << bufferBits;
+            bufferBits += digitBits;
+            column++;
         }
-        zds[j] = qhat;
+        dest[i] = (WordType)buffer;
+        buffer >>= BitsPerWord;
+        bufferBits -= BitsPerWord;
     }
-    while (--j >= ny);
 }
 
-void BigUnsigned::divMod(BigUnsigned dividend, BigUnsigned divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+// columns[c] = sum of a[c - i] * b[i]; aPadded holds bDigits zeros, a and then zeros up to the last column
+__attribute__((target("avx2"))) static void multiplyColumnsAvx2(uint64_t columns[], size_t columnCount, const uint64_t aPadded[], const uint64_t b[], size_t bDigits)
 {
-    if(dividend.data->size == 1 && divisor.data->size == 1)
+    for(size_t c = 0; c < columnCount; c += 4)
     {
-        ::divMod(dividend.data->words[0], divisor.data->words[0], pquotient, premainder);
-        return;
+        __m256i sum = _mm256_setzero_si256();
+        for(size_t i = 0; i < bDigits; i++)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(aPadded + bDigits + c - i));
+            sum = _mm256_add_epi64(sum, _mm256_mul_epu32(x, _mm256_set1_epi64x(b[i])));
+        }
+        _mm256_storeu_si256((__m256i *)(columns + c), sum);
     }
-    else if(dividend.data->size == 1)
+}
+
+__attribute__((target("avx512f"))) static void multiplyColumnsAvx512(uint64_t columns[], size_t columnCount, const uint64_t aPadded[], const uint64_t b[], size_t bDigits)
+{
+    for(size_t c = 0; c < columnCount; c += 8)
     {
-        divMod(dividend.data->words[0], divisor, pquotient, premainder);
-        return;
+        __m512i sum = _mm512_setzero_si512();
+        for(size_t i = 0; i < bDigits; i++)
+        {
+            __m512i x = _mm512_loadu_si512((const void *)(aPadded + bDigits + c - i));
+            sum = _mm512_add_epi64(sum, _mm512_maskz_mul_epu32(0xFF, x, _mm512_set1_epi64(b[i]))); // the unmasked form trips -Wmaybe-uninitialized in GCC 12
+        }
+        _mm512_storeu_si512((void *)(columns + c), sum);
     }
-    else if(divisor.data->size == 1)
+}
+
+__attribute__((target("avx512f,avx512ifma"))) static void multiplyColumnsAvx512Ifma(uint64_t low[], uint64_t high[], size_t columnCount, const uint64_t aPadded[], const uint64_t b[], size_t bDigits)
+{
+    for(size_t c = 0; c < columnCount; c += 8)
     {
-        divMod(dividend, divisor.data->words[0], pquotient, premainder);
-        return;
+        __m512i lowSum = _mm512_setzero_si512();
+        __m512i highSum = _mm512_setzero_si512();
+        for(size_t i = 0; i < bDigits; i++)
+        {
+            __m512i x = _mm512_loadu_si512((const void *)(aPadded + bDigits + c - i));
+            __m512i y = _mm512_set1_epi64(b[i]);
+            lowSum = _mm512_madd52lo_epu64(lowSum, x, y);
+            highSum = _mm512_madd52hi_epu64(highSum, x, y);
+        }
+        _mm512_storeu_si512((void *)(low + c), lowSum);
+        _mm512_storeu_si512((void *)(high + c), highSum);
     }
-    if(dividend < divisor)
+}
+
+static void multiplyWordsSimd(SimdKernel kernel, WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize) // aSize and bSize must be at most SimdMaxOperandBits / BitsPerWord
+{
+    unsigned digitBits = (kernel == SimdAvx512Ifma ? 52 : 28);
+    uint64_t aPadded[3 * SimdMaxDigits + 8], bDigits[SimdMaxDigits];
+    uint64_t low[SimdColumnCount], high[SimdColumnCount];
+    size_t bDigitCount = unpackDigits(bDigits, b, bSize, digitBits);
+    for(size_t i = 0; i < bDigitCount; i++)
+        aPadded[i] = 0;
+    size_t aDigitCount = unpackDigits(aPadded + bDigitCount, a, aSize, digitBits);
+    size_t columnCount = (aDigitCount + bDigitCount + 7) & ~(size_t)7;
+    for(size_t i = bDigitCount + aDigitCount; i < bDigitCount + columnCount; i++)
+        aPadded[i] = 0;
+    switch(kernel)
     {
-        if(pquotient)
-            *pquotient = 0;
-        if(premainder)
-            *premainder = dividend;
+    case SimdAvx512Ifma:
+        multiplyColumnsAvx512Ifma(low, high, columnCount, aPadded, bDigits, bDigitCount);
+        packColumns(dest, aSize + bSize, low, high, digitBits);
         return;
+    case SimdAvx512:
+        multiplyColumnsAvx512(low, columnCount, aPadded, bDigits, bDigitCount);
+        break;
+    default:
+        multiplyColumnsAvx2(low, columnCount, aPadded, bDigits, bDigitCount);
+        break;
     }
-    if(dividend == divisor)
-    {
-        if(pquotient)
+    packColumns(dest, aSize + bSize, low, NULL, digitBits);
+}
+#endif
+
+static void multiplyWordsSchoolbook(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize) // dest must hold aSize + bSize words and not overlap a or b
+{
+#ifdef BIGMATH_SIMD_KERNELS
+    if(useSimdSchoolbook(bSize))
+    {
+        SimdKernel simdKernel = simdSchoolbook().kernel;
+        const size_t pieceSize = SimdMaxOperandBits / BitsPerWord;
+        multiplyWordsSimd(simdKernel, dest, a, min(aSize, pieceSize), b, bSize);
+        for(size_t offset = pieceSize; offset < aSize; offset += pieceSize)
+        {
+            // the previous piece already wrote dest[offset : offset + bSize - 1]
+            WordType piece[2 * pieceSize];
+            size_t size = min(aSize - offset, pieceSize);
+            multiplyWordsSimd(simdKernel, piece, a + offset, size, b, bSize);
+            addWords(dest + offset, piece, size + bSize, dest + offset, bSize);
+        }
+        return;
+    }
+#endif
+    WordType carry = 0;
+    for(size_t i = 0; i < aSize; i++)
+    {
+        multiplyDoubleWordAndAdd(a[i], b[0], carry, carry, dest[i]);
+    }
+    dest[aSize] = carry;
+    for(size_t i = 1; i < bSize; i++)
+    {
+        carry = 0;
+        for(size_t j = 0; j < aSize; j++)
+        {
+            multiplyDoubleWordAndAddTwo(a[j], b[i], carry, dest[i + j], carry, dest[i + j]);
+        }
+        dest[i + aSize] = carry;
+    }
+}
+
+static void squareWordsSchoolbook(WordType dest[], const WordType a[], size_t size) // dest must hold 2 * size words and not overlap a
+{
+    // sum the products a[i] * a[j] with i < j once, double them and then add the squares a[i] * a[i]
+    for(size_t i = 0; i < 2 * size; i++)
+        dest[i] = 0;
+    for(size_t i = 0; i + 1 < size; i++)
+    {
+        dest[i + size] = addmul_1(dest + 2 * i + 1, a + i + 1, size - i - 1, a[i]);
+    }
+    lshiftWords(dest, dest, 2 * size, 1);
+    bool carry = false;
+    for(size_t i = 0; i < size; i++)
+    {
+        WordType highWord, lowWord;
+        multiplyDoubleWord(a[i], a[i], highWord, lowWord);
+        addWithCarry(dest[2 * i], lowWord, carry, dest[2 * i], carry);
+        addWithCarry(dest[2 * i + 1], highWord, carry, dest[2 * i + 1], carry);
+    }
+}
+
+/* Fixed-size multiplication.
+ *
+ * At the sizes of typical keys the loop control of the general kernels costs about as much as the multiplications
+ * themselves.  These kernels are the same schoolbook algorithms unrolled at compile time for one operand size each, so
+ * a product of two 256-bit or 512-bit numbers is straight-line code picked from a table by size.  The tables stop
+ * where the unrolled code gets too big for the instruction cache and the loops win again.
+ */
+#if defined(__GNUC__)
+#define BIGMATH_ALWAYS_INLINE __attribute__((always_inline))
+#else
+#define BIGMATH_ALWAYS_INLINE
+#endif
+
+template<size_t I, size_t N>
+struct UnrolledLoop // calls body(I), body(I + 1), ..., body(N - 1) with constant indices
+{
+    template<typename Body>
+    BIGMATH_ALWAYS_INLINE static inline void run(const Body & body)
+    {
+        body(I);
+        UnrolledLoop<I + 1, N>::run(body);
+    }
+};
+
+template<size_t N>
+struct UnrolledLoop<N, N>
+{
+    template<typename Body>
+    BIGMATH_ALWAYS_INLINE static inline void run(const Body &)
+    {
+    }
+};
+
+template<size_t N>
+static void multiplyWordsFixed(WordType dest[], const WordType a[], const WordType b[]) // dest must hold 2 * N words and not overlap a or b
+{
+    WordType carry = 0;
+    UnrolledLoop<0, N>::run([&](size_t j) BIGMATH_ALWAYS_INLINE
+    {
+        multiplyDoubleWordAndAdd(a[j], b[0], carry, carry, dest[j]);
+    });
+    dest[N] = carry;
+    UnrolledLoop<1, N>::run([&](size_t i) BIGMATH_ALWAYS_INLINE
+    {
+        WordType rowCarry = 0;
+        UnrolledLoop<0, N>::run([&](size_t j) BIGMATH_ALWAYS_INLINE
+        {
+            multiplyDoubleWordAndAddTwo(a[j], b[i], rowCarry, dest[i + j], rowCarry, dest[i + j]);
+        });
+        dest[i + N] = rowCarry;
+    });
+}
+
+template<size_t N>
+static void squareWordsFixed(WordType dest[], const WordType a[]) // dest must hold 2 * N words and not overlap a; N >= 2
+{
+    // same as squareWordsSchoolbook, with the doubling folded into the pass that adds the squares
+    dest[0] = 0;
+    WordType carry = 0;
+    UnrolledLoop<1, N>::run([&](size_t j) BIGMATH_ALWAYS_INLINE
+    {
+        multiplyDoubleWordAndAdd(a[j], a[0], carry, carry, dest[j]);
+    });
+    dest[N] = carry;
+    UnrolledLoop<1, N - 1>::run([&](size_t i) BIGMATH_ALWAYS_INLINE
+    {
+        WordType rowCarry = 0;
+        UnrolledLoop<2, N>::run([&](size_t j) BIGMATH_ALWAYS_INLINE
+        {
+            if(j > i)
+                multiplyDoubleWordAndAddTwo(a[j], a[i], rowCarry, dest[i + j], rowCarry, dest[i + j]);
+        });
+        dest[i + N] = rowCarry;
+    });
+    dest[2 * N - 1] = 0;
+    WordType shiftedOut = 0;
+    bool squareCarry = false;
+    UnrolledLoop<0, N>::run([&](size_t i) BIGMATH_ALWAYS_INLINE
+    {
+        WordType highWord, lowWord;
+        multiplyDoubleWord(a[i], a[i], highWord, lowWord);
+        WordType low = dest[2 * i], high = dest[2 * i + 1];
+        addWithCarry((low << 1) | shiftedOut, lowWord, squareCarry, dest[2 * i], squareCarry);
+        addWithCarry((high << 1) | (low >> (BitsPerWord - 1)), highWord, squareCarry, dest[2 * i + 1], squareCarry);
+        shiftedOut = high >> (BitsPerWord - 1);
+    });
+}
+
+typedef void (*FixedMultiplyKernel)(WordType dest[], const WordType a[], const WordType b[]);
+typedef void (*FixedSquareKernel)(WordType dest[], const WordType a[]);
+
+static const size_t FixedMultiplyMaxWords = 12;
+static const size_t FixedSquareMaxWords = 16;
+
+static const FixedMultiplyKernel fixedMultiplyKernels[FixedMultiplyMaxWords + 1] =
+{
+    NULL, multiplyWordsFixed<1>, multiplyWordsFixed<2>, multiplyWordsFixed<3>, multiplyWordsFixed<4>,
+    multiplyWordsFixed<5>, multiplyWordsFixed<6>, multiplyWordsFixed<7>, multiplyWordsFixed<8>,
+    multiplyWordsFixed<9>, multiplyWordsFixed<10>, multiplyWordsFixed<11>, multiplyWordsFixed<12>,
+};
+
+static const FixedSquareKernel fixedSquareKernels[FixedSquareMaxWords + 1] =
+{
+    NULL, NULL, squareWordsFixed<2>, squareWordsFixed<3>, squareWordsFixed<4>,
+    squareWordsFixed<5>, squareWordsFixed<6>, squareWordsFixed<7>, squareWordsFixed<8>,
+    squareWordsFixed<9>, squareWordsFixed<10>, squareWordsFixed<11>, squareWordsFixed<12>,
+    squareWordsFixed<13>, squareWordsFixed<14>, squareWordsFixed<15>, squareWordsFixed<16>,
+};
+
+/* Karatsuba multiplication : with a = a1 * W^h + a0 and b = b1 * W^h + b0,
+ * a * b = a1 * b1 * W^2h + (a0 * b0 + a1 * b1 - (a0 - a1) * (b0 - b1)) * W^h + a0 * b0
+ * Requires aSize >= bSize > (aSize + 1) / 2 so that both high halves are non-empty.
+ * When a and b are the same operand only the squares are computed, since (a0 - a1)^2 is never negative.
+ */
+static void multiplyWordsKaratsuba(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize)
+{
+    size_t h = (aSize + 1) / 2;
+    size_t a1Size = aSize - h, b1Size = bSize - h;
+    size_t productSize = aSize + bSize;
+    multiplyWords(dest, a, h, b, h);
+    multiplyWords(dest + 2 * h, a + h, a1Size, b + h, b1Size);
+    vector<WordType> temp(6 * h + 1);
+    WordType * aDiff = &temp[0];
+    WordType * bDiff = aDiff + h;
+    WordType * middleProduct = bDiff + h;
+    WordType * middle = middleProduct + 2 * h;
+    bool negative = subtractWordsAbsolute(aDiff, a, h, a + h, a1Size);
+    if(a == b && aSize == bSize)
+    {
+        negative = false;
+        bDiff = aDiff;
+    }
+    else if(subtractWordsAbsolute(bDiff, b, h, b + h, b1Size))
+        negative = !negative;
+    multiplyWords(middleProduct, aDiff, h, bDiff, h);
+    middle[2 * h] = addWords(middle, dest, 2 * h, dest + 2 * h, productSize - 2 * h) ? 1 : 0;
+    if(negative)
+        addWords(middle, middle, 2 * h + 1, middleProduct, 2 * h);
+    else
+        subtractWords(middle, middle, 2 * h + 1, middleProduct, 2 * h);
+    addWords(dest + h, dest + h, productSize - h, middle, min(2 * h + 1, productSize - h));
+}
+
+static bool evaluateToom3(WordType p1[], WordType pm1[], WordType p2[], const WordType a[], size_t k, size_t a2Size) // evaluates a at 1, -1 and 2 into k + 1 words each; returns true if a(-1) < 0
+{
+    p1[k] = addWords(p1, a, k, a + 2 * k, a2Size) ? 1 : 0;
+    bool negative = subtractWordsAbsolute(pm1, p1, k + 1, a + k, k);
+    addWords(p1, p1, k + 1, a + k, k);
+    for(size_t i = 0; i < k; i++)
+        p2[i] = a[i];
+    p2[k] = 0;
+    addmulWords(p2, k + 1, a + k, k, 2);
+    addmulWords(p2, k + 1, a + 2 * k, a2Size, 4);
+    return negative;
+}
+
+/* Toom-Cook 3-way multiplication : splits both operands into 3 pieces of k words, evaluates at 0, 1, -1, 2 and infinity
+ * and interpolates in an order that keeps every intermediate value non-negative.
+ * Requires aSize >= bSize > 2 * k where k = ceil(aSize / 3).
+ */
+static void multiplyWordsToom3(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize)
+{
+    size_t k = (aSize + 2) / 3;
+    size_t a2Size = aSize - 2 * k, b2Size = bSize - 2 * k;
+    size_t productSize = aSize + bSize, highSize = a2Size + b2Size;
+    size_t n = k + 1, length = 2 * n;
+    vector<WordType> temp(6 * n + 5 * length);
+    WordType * ap1 = &temp[0];
+    WordType * am1 = ap1 + n;
+    WordType * ap2 = am1 + n;
+    WordType * bp1 = ap2 + n;
+    WordType * bm1 = bp1 + n;
+    WordType * bp2 = bm1 + n;
+    WordType * v1 = bp2 + n;
+    WordType * vm1 = v1 + length;
+    WordType * v2 = vm1 + length;
+    WordType * s = v2 + length;
+    WordType * d = s + length;
+    bool vm1Negative = evaluateToom3(ap1, am1, ap2, a, k, a2Size);
+    if(a == b && aSize == bSize) // squaring
+    {
+        vm1Negative = false;
+        bp1 = ap1;
+        bm1 = am1;
+        bp2 = ap2;
+    }
+    else if(evaluateToom3(bp1, bm1, bp2, b, k, b2Size))
+        vm1Negative = !vm1Negative;
+    WordType * v0 = dest;
+    WordType * vInf = dest + 4 * k;
+    multiplyWords(v0, a, k, b, k);
+    multiplyWords(vInf, a + 2 * k, a2Size, b + 2 * k, b2Size);
+    for(size_t i = 2 * k; i < 4 * k; i++)
+        dest[i] = 0;
+    multiplyWords(v1, ap1, n, bp1, n);
+    multiplyWords(vm1, am1, n, bm1, n);
+    multiplyWords(v2, ap2, n, bp2, n);
+
+    // s = (v(1) + v(-1)) / 2 = c0 + c2 + c4, d = (v(1) - v(-1)) / 2 = c1 + c3
+    if(vm1Negative)
+    {
+        subtractWords(s, v1, length, vm1, length);
+        addWords(d, v1, length, vm1, length);
+    }
+    else
+    {
+        addWords(s, v1, length, vm1, length);
+        subtractWords(d, v1, length, vm1, length);
+    }
+    rshiftWords(s, s, length, 1);
+    rshiftWords(d, d, length, 1);
+    subtractWords(s, s, length, v0, 2 * k);
+    subtractWords(s, s, length, vInf, highSize); // s = c2
+    subtractWords(v2, v2, length, v0, 2 * k);
+    submulWords(v2, length, vInf, highSize, 16);
+    rshiftWords(v2, v2, length, 1); // v2 = c1 + 2 * c2 + 4 * c3
+    submulWords(v2, length, s, length, 2);
+    subtractWords(v2, v2, length, d, length);
+    divideWordsByWord(v2, v2, length, 3); // v2 = c3
+    subtractWords(d, d, length, v2, length); // d = c1
+
+    addWordsAt(dest, productSize, k, d, length);
+    addWordsAt(dest, productSize, 2 * k, s, length);
+    addWordsAt(dest, productSize, 3 * k, v2, length);
+}
+
+static void evaluateToom4(WordType p1[], WordType pm1[], WordType p2[], WordType pm2[], WordType ph[], WordType temp[], const WordType a[], size_t k, size_t a3Size, bool & m1Negative, bool & m2Negative) // evaluates a at 1, -1, 2, -2 and 8 * a(1 / 2) into k + 1 words each; temp must hold 2 * (k + 1) words
+{
+    size_t n = k + 1;
+    WordType * even = temp;
+    WordType * odd = temp + n;
+    even[k] = addWords(even, a, k, a + 2 * k, k) ? 1 : 0;
+    odd[k] = addWords(odd, a + k, k, a + 3 * k, a3Size) ? 1 : 0;
+    addWords(p1, even, n, odd, n);
+    m1Negative = subtractWordsAbsolute(pm1, even, n, odd, n);
+    for(size_t i = 0; i < k; i++)
+    {
+        even[i] = a[i];
+        odd[i] = 0;
+    }
+    even[k] = 0;
+    odd[k] = 0;
+    addmulWords(even, n, a + 2 * k, k, 4);
+    addmulWords(odd, n, a + k, k, 2);
+    addmulWords(odd, n, a + 3 * k, a3Size, 8);
+    addWords(p2, even, n, odd, n);
+    m2Negative = subtractWordsAbsolute(pm2, even, n, odd, n);
+    for(size_t i = 0; i < n; i++)
+        ph[i] = 0;
+    addmulWords(ph, n, a, k, 8);
+    addmulWords(ph, n, a + k, k, 4);
+    addmulWords(ph, n, a + 2 * k, k, 2);
+    addWords(ph, ph, n, a + 3 * k, a3Size);
+}
+
+/* Toom-Cook 4-way multiplication : splits both operands into 4 pieces of k words, evaluates at 0, 1, -1, 2, -2, 1/2
+ * and infinity and interpolates in an order that keeps every intermediate value non-negative.
+ * Requires aSize >= bSize > 3 * k where k = ceil(aSize / 4).
+ */
+static void multiplyWordsToom4(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize)
+{
+    size_t k = (aSize + 3) / 4;
+    size_t a3Size = aSize - 3 * k, b3Size = bSize - 3 * k;
+    size_t productSize = aSize + bSize, highSize = a3Size + b3Size;
+    size_t n = k + 1, length = 2 * n;
+    vector<WordType> temp(12 * n + 5 * length);
+    WordType * ap1 = &temp[0];
+    WordType * am1 = ap1 + n;
+    WordType * ap2 = am1 + n;
+    WordType * am2 = ap2 + n;
+    WordType * aph = am2 + n;
+    WordType * bp1 = aph + n;
+    WordType * bm1 = bp1 + n;
+    WordType * bp2 = bm1 + n;
+    WordType * bm2 = bp2 + n;
+    WordType * bph = bm2 + n;
+    WordType * v1 = bph + 3 * n;
+    WordType * vm1 = v1 + length;
+    WordType * v2 = vm1 + length;
+    WordType * vm2 = v2 + length;
+    WordType * vh = vm2 + length;
+    bool aM1Negative, aM2Negative, bM1Negative, bM2Negative;
+    evaluateToom4(ap1, am1, ap2, am2, aph, bph + n, a, k, a3Size, aM1Negative, aM2Negative);
+    if(a == b && aSize == bSize) // squaring
+    {
+        bM1Negative = aM1Negative;
+        bM2Negative = aM2Negative;
+        bp1 = ap1;
+        bm1 = am1;
+        bp2 = ap2;
+        bm2 = am2;
+        bph = aph;
+    }
+    else
+        evaluateToom4(bp1, bm1, bp2, bm2, bph, bph + n, b, k, b3Size, bM1Negative, bM2Negative);
+    bool vm1Negative = (aM1Negative != bM1Negative);
+    bool vm2Negative = (aM2Negative != bM2Negative);
+    WordType * v0 = dest;
+    WordType * vInf = dest + 6 * k;
+    multiplyWords(v0, a, k, b, k);
+    multiplyWords(vInf, a + 3 * k, a3Size, b + 3 * k, b3Size);
+    for(size_t i = 2 * k; i < 6 * k; i++)
+        dest[i] = 0;
+    multiplyWords(v1, ap1, n, bp1, n);
+    multiplyWords(vm1, am1, n, bm1, n);
+    multiplyWords(v2, ap2, n, bp2, n);
+    multiplyWords(vm2, am2, n, bm2, n);
+    multiplyWords(vh, aph, n, bph, n);
+
+    // split v(1), v(-1) and v(2), v(-2) into their even and odd parts, reusing the evaluation space
+    WordType * e1 = ap1;
+    WordType * o1 = e1 + length;
+    WordType * e2 = o1 + length;
+    WordType * o2 = e2 + length;
+    if(vm1Negative)
+    {
+        subtractWords(e1, v1, length, vm1, length);
+        addWords(o1, v1, length, vm1, length);
+    }
+    else
+    {
+        addWords(e1, v1, length, vm1, length);
+        subtractWords(o1, v1, length, vm1, length);
+    }
+    if(vm2Negative)
+    {
+        subtractWords(e2, v2, length, vm2, length);
+        addWords(o2, v2, length, vm2, length);
+    }
+    else
+    {
+        addWords(e2, v2, length, vm2, length);
+        subtractWords(o2, v2, length, vm2, length);
+    }
+    rshiftWords(e1, e1, length, 1);
+    subtractWords(e1, e1, length, v0, 2 * k);
+    subtractWords(e1, e1, length, vInf, highSize); // e1 = c2 + c4
+    rshiftWords(o1, o1, length, 1); // o1 = c1 + c3 + c5
+    rshiftWords(e2, e2, length, 1);
+    subtractWords(e2, e2, length, v0, 2 * k);
+    submulWords(e2, length, vInf, highSize, 64);
+    rshiftWords(e2, e2, length, 2); // e2 = c2 + 4 * c4
+    rshiftWords(o2, o2, length, 2); // o2 = c1 + 4 * c3 + 16 * c5
+
+    subtractWords(e2, e2, length, e1, length);
+    divideWordsByWord(e2, e2, length, 3); // e2 = c4
+    subtractWords(e1, e1, length, e2, length); // e1 = c2
+
+    submulWords(vh, length, v0, 2 * k, 64);
+    submulWords(vh, length, e1, length, 16);
+    submulWords(vh, length, e2, length, 4);
+    subtractWords(vh, vh, length, vInf, highSize);
+    rshiftWords(vh, vh, length, 1); // vh = 16 * c1 + 4 * c3 + c5
+
+    subtractWords(o2, o2, length, o1, length);
+    divideWordsByWord(o2, o2, length, 3); // o2 = c3 + 5 * c5
+    subtractWords(vh, vh, length, o1, length);
+    divideWordsByWord(vh, vh, length, 3); // vh = 5 * c1 + c3
+    addmulWords(o1, length, o1, length, 4);
+    subtractWords(o1, o1, length, o2, length);
+    subtractWords(o1, o1, length, vh, length);
+    divideWordsByWord(o1, o1, length, 3); // o1 = c3
+    subtractWords(o2, o2, length, o1, length);
+    divideWordsByWord(o2, o2, length, 5); // o2 = c5
+    subtractWords(vh, vh, length, o1, length);
+    divideWordsByWord(vh, vh, length, 5); // vh = c1
+
+    addWordsAt(dest, productSize, k, vh, length);
+    addWordsAt(dest, productSize, 2 * k, e1, length);
+    addWordsAt(dest, productSize, 3 * k, o1, length);
+    addWordsAt(dest, productSize, 4 * k, e2, length);
+    addWordsAt(dest, productSize, 5 * k, o2, length);
+}
+
+static WordType inverseModWord(WordType v) // returns v^-1 mod 2^BitsPerWord; v must be odd
+{
+    WordType retval = v; // correct to 3 bits
+    for(size_t bits = 3; bits < BitsPerWord; bits *= 2)
+        retval *= 2 - v * retval;
+    return retval;
+}
+
+/* Number-theoretic transform multiplication : the operands are convolved modulo three word-sized primes
+ * of the form k * 2^m + 1 and the exact coefficients are recovered with the chinese remainder theorem.
+ * Arithmetic modulo each prime uses Montgomery multiplication with R = 2^BitsPerWord.
+ */
+struct NttPrime
+{
+    WordType modulus;
+    WordType generator;
+    WordType inverse; // modulus^-1 mod R
+    WordType r2; // R^2 mod modulus
+    NttPrime(WordType modulus, WordType generator)
+        : modulus(modulus), generator(generator), inverse(inverseModWord(modulus))
+    {
+        WordType quotient, r, highWord, lowWord;
+        divideDoubleWord(1, 0, modulus, quotient, r);
+        multiplyDoubleWord(r, r, highWord, lowWord);
+        divideDoubleWord(highWord, lowWord, modulus, quotient, r2);
+    }
+};
+
+static const size_t NttPrimeCount = 3;
+#ifdef BIGMATH_64BIT_WORDS
+static const size_t MaxNttLength = (size_t)1 << 57;
+static const NttPrime nttPrimes[NttPrimeCount] =
+{
+    NttPrime(0xD800000000000001ULL, 5), // 27 * 2^59 + 1
+    NttPrime(0xF600000000000001ULL, 7), // 123 * 2^57 + 1
+    NttPrime(0xBE00000000000001ULL, 3), // 95 * 2^57 + 1
+};
+#else
+static const size_t MaxNttLength = (size_t)1 << 27;
+static const NttPrime nttPrimes[NttPrimeCount] =
+{
+    NttPrime(3221225473U, 5), // 3 * 2^30 + 1
+    NttPrime(3489660929U, 3), // 13 * 2^28 + 1
+    NttPrime(2013265921U, 31), // 15 * 2^27 + 1
+};
+#endif
+
+static inline WordType nttMultiply(WordType a, WordType b, const NttPrime & prime) // returns a * b * R^-1 mod modulus
+{
+    WordType highWord, lowWord, mHighWord, mLowWord;
+    multiplyDoubleWord(a, b, highWord, lowWord);
+    multiplyDoubleWord(lowWord * prime.inverse, prime.modulus, mHighWord, mLowWord);
+    return highWord - mHighWord + (prime.modulus & -(WordType)(highWord < mHighWord));
+}
+
+static inline WordType nttAdd(WordType a, WordType b, const NttPrime & prime)
+{
+    WordType retval = a + b;
+    return retval - (prime.modulus & -(WordType)(retval < a || retval >= prime.modulus));
+}
+
+static inline WordType nttSubtract(WordType a, WordType b, const NttPrime & prime)
+{
+    return a - b + (prime.modulus & -(WordType)(a < b));
+}
+
+static inline WordType nttReduce(WordType v, const NttPrime & prime)
+{
+    while(v >= prime.modulus)
+        v -= prime.modulus;
+    return v;
+}
+
+static WordType nttToMontgomery(WordType v, const NttPrime & prime)
+{
+    return nttMultiply(nttReduce(v, prime), prime.r2, prime);
+}
+
+static WordType nttPow(WordType base, WordType exponent, const NttPrime & prime) // base and the result are in Montgomery form
+{
+    WordType retval = nttToMontgomery(1, prime);
+    for(; exponent != 0; exponent >>= 1)
+    {
+        if(exponent & 1)
+            retval = nttMultiply(retval, base, prime);
+        base = nttMultiply(base, base, prime);
+    }
+    return retval;
+}
+
+static void computeNttRoots(WordType roots[], size_t n, bool inverse, const NttPrime & prime) // roots[h + j] = w_2h^j for each power of 2 h < n, in Montgomery form
+{
+    if(n < 2)
+        return;
+    WordType root = nttPow(nttToMontgomery(prime.generator, prime), (prime.modulus - 1) / n, prime);
+    if(inverse)
+        root = nttPow(root, (WordType)(n - 1), prime);
+    size_t half = n / 2;
+    roots[half] = nttToMontgomery(1, prime);
+    for(size_t j = 1; j < half; j++)
+        roots[half + j] = nttMultiply(roots[half + j - 1], root, prime);
+    for(size_t h = half / 2; h >= 1; h /= 2)
+    {
+        for(size_t j = 0; j < h; j++)
+            roots[h + j] = roots[2 * (h + j)];
+    }
+}
+
+static void nttForward(WordType a[], size_t n, const WordType roots[], const NttPrime & prime) // decimation in frequency; leaves the result in bit-reversed order
+{
+    for(size_t half = n / 2; half >= 1; half /= 2)
+    {
+        for(size_t start = 0; start < n; start += 2 * half)
+        {
+            for(size_t j = 0; j < half; j++)
+            {
+                WordType x = a[start + j], y = a[start + j + half];
+                a[start + j] = nttAdd(x, y, prime);
+                a[start + j + half] = nttMultiply(nttSubtract(x, y, prime), roots[half + j], prime);
+            }
+        }
+    }
+}
+
+static void nttInverse(WordType a[], size_t n, const WordType inverseRoots[], const NttPrime & prime) // decimation in time; takes its input in bit-reversed order and leaves out the 1 / n factor
+{
+    for(size_t half = 1; half < n; half *= 2)
+    {
+        for(size_t start = 0; start < n; start += 2 * half)
+        {
+            for(size_t j = 0; j < half; j++)
+            {
+                WordType x = a[start + j], y = nttMultiply(a[start + j + half], inverseRoots[half + j], prime);
+                a[start + j] = nttAdd(x, y, prime);
+                a[start + j + half] = nttSubtract(x, y, prime);
+            }
+        }
+    }
+}
+
+static void nttLoad(WordType dest[], size_t n, const WordType src[], size_t size, const NttPrime & prime)
+{
+    for(size_t i = 0; i < size; i++)
+        dest[i] = nttReduce(src[i], prime);
+    for(size_t i = size; i < n; i++)
+        dest[i] = 0;
+}
+
+static void nttCombine(WordType dest[], size_t destSize, const WordType residues[], size_t n) // chinese remainder theorem (Garner's algorithm); residues holds n coefficients for each prime
+{
+    const NttPrime & p1 = nttPrimes[0];
+    const NttPrime & p2 = nttPrimes[1];
+    const NttPrime & p3 = nttPrimes[2];
+    // constants in Montgomery form so that nttMultiply by them gives normal results
+    WordType p1InverseModP2 = nttPow(nttToMontgomery(p1.modulus, p2), p2.modulus - 2, p2);
+    WordType p1ModP3 = nttToMontgomery(p1.modulus, p3);
+    WordType p1p2InverseModP3 = nttPow(nttMultiply(p1ModP3, nttToMontgomery(p2.modulus, p3), p3), p3.modulus - 2, p3);
+    WordType carry[3] = {0, 0, 0};
+    for(size_t i = 0; i < destSize; i++)
+    {
+        WordType x[3] = {0, 0, 0};
+        if(i < n)
+        {
+            WordType r1 = residues[i], r2 = residues[n + i], r3 = residues[2 * n + i];
+            WordType t2 = nttMultiply(nttSubtract(r2, nttReduce(r1, p2), p2), p1InverseModP2, p2);
+            WordType u = nttSubtract(r3, nttReduce(r1, p3), p3);
+            u = nttSubtract(u, nttMultiply(nttReduce(t2, p3), p1ModP3, p3), p3);
+            WordType t3 = nttMultiply(u, p1p2InverseModP3, p3);
+            WordType yHighWord, yLowWord, c;
+            multiplyDoubleWordAndAdd(p2.modulus, t3, t2, yHighWord, yLowWord);
+            multiplyDoubleWordAndAdd(p1.modulus, yLowWord, r1, c, x[0]);
+            multiplyDoubleWordAndAdd(p1.modulus, yHighWord, c, x[2], x[1]);
+        }
+        bool c = addWords(carry, carry, 3, x, 3);
+        dest[i] = carry[0];
+        carry[0] = carry[1];
+        carry[1] = carry[2];
+        carry[2] = c ? 1 : 0;
+    }
+}
+
+static size_t nttLength(size_t productSize) // the convolution has productSize - 1 coefficients
+{
+    size_t n = 1;
+    while(n < productSize - 1)
+        n *= 2;
+    return n;
+}
+
+static void nttTransform(WordType dest[], size_t n, const WordType a[], size_t aSize) // dest holds n words for each prime
+{
+    vector<WordType> roots(n);
+    for(size_t i = 0; i < NttPrimeCount; i++)
+    {
+        const NttPrime & prime = nttPrimes[i];
+        computeNttRoots(&roots[0], n, false, prime);
+        nttLoad(dest + i * n, n, a, aSize, prime);
+        nttForward(dest + i * n, n, &roots[0], prime);
+    }
+}
+
+static void multiplyTransformed(WordType dest[], size_t productSize, WordType aTransform[], const WordType bTransform[], size_t n) // aTransform is overwritten
+{
+    vector<WordType> inverseRoots(n);
+    for(size_t i = 0; i < NttPrimeCount; i++)
+    {
+        const NttPrime & prime = nttPrimes[i];
+        WordType * r = aTransform + i * n;
+        const WordType * t = bTransform + i * n;
+        computeNttRoots(&inverseRoots[0], n, true, prime);
+        for(size_t j = 0; j < n; j++)
+            r[j] = nttMultiply(r[j], t[j], prime);
+        nttInverse(r, n, &inverseRoots[0], prime);
+        // the pointwise products picked up a factor of R^-1, so scale by R / n
+        WordType scale = nttMultiply(nttPow(nttToMontgomery((WordType)n, prime), prime.modulus - 2, prime), prime.r2, prime);
+        for(size_t j = 0; j < n; j++)
+            r[j] = nttMultiply(r[j], scale, prime);
+    }
+    nttCombine(dest, productSize, aTransform, n);
+}
+
+static void multiplyWordsNtt(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize) // requires aSize + bSize <= MaxNttLength
+{
+    size_t productSize = aSize + bSize;
+    size_t n = nttLength(productSize);
+    vector<WordType> aTransform(NttPrimeCount * n);
+    nttTransform(&aTransform[0], n, a, aSize);
+    if(a == b && aSize == bSize) // squaring
+    {
+        multiplyTransformed(dest, productSize, &aTransform[0], &aTransform[0], n);
+        return;
+    }
+    vector<WordType> bTransform(NttPrimeCount * n);
+    nttTransform(&bTransform[0], n, b, bSize);
+    multiplyTransformed(dest, productSize, &aTransform[0], &bTransform[0], n);
+}
+
+static void foldWords(WordType dest[], size_t n, const WordType src[], size_t size) // dest[0:n-1] = src mod 2^(n*BitsPerWord) - 1, which may come out as the modulus itself
+{
+    const WordType one = 1;
+    for(size_t i = 0; i < n; i++)
+        dest[i] = (i < size ? src[i] : 0);
+    for(size_t offset = n; offset < size; offset += n)
+    {
+        // 2^(n*BitsPerWord) is 1 mod the modulus, so the carry out of the top goes back in at the bottom
+        if(addWords(dest, dest, n, src + offset, min(n, size - offset)))
+            addWords(dest, dest, n, &one, 1);
+    }
+}
+
+/* The transform is a cyclic convolution, so a transform of length n gives the product modulo 2^(n*BitsPerWord) - 1
+ * directly, at half the length of the full product when that is all the caller needs. aTransform is overwritten.
+ */
+static void multiplyTransformedWrapped(WordType dest[], WordType aTransform[], const WordType bTransform[], size_t n) // dest gets n words, which may come out as the modulus itself
+{
+    vector<WordType> product(n + 3);
+    multiplyTransformed(&product[0], n + 3, aTransform, bTransform, n);
+    foldWords(dest, n, &product[0], n + 3);
+}
+
+static const size_t KaratsubaThreshold = 24;
+static const size_t KaratsubaSquareThreshold = 48;
+#ifdef BIGMATH_64BIT_WORDS
+// modular products of 64-bit residues cost more, so the transform pays off later
+static const size_t NttThreshold = 12000;
+static const size_t MultiplierNttThreshold = 9000;
+#else
+static const size_t NttThreshold = 7000;
+static const size_t MultiplierNttThreshold = 5000;
+#endif
+static const size_t Toom3Threshold = 250;
+static const size_t Toom4Threshold = 700;
+
+/* Unbalanced multiplication : a is sliced into pieces about as long as b, which are multiplied by b with the
+ * balanced kernels and accumulated into dest. When b is large enough for the NTT it is only transformed once
+ * and the pieces are sized to fill the transform.
+ * Requires aSize > bSize.
+ */
+static void multiplyWordsUnbalanced(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize)
+{
+    size_t n = 0, chunkSize = bSize;
+    vector<WordType> bTransform, chunkTransform;
+    if(bSize >= NttThreshold && 2 * bSize <= MaxNttLength)
+    {
+        n = nttLength(2 * bSize);
+        chunkSize = n + 1 - bSize;
+        bTransform.resize(NttPrimeCount * n);
+        chunkTransform.resize(NttPrimeCount * n);
+        nttTransform(&bTransform[0], n, b, bSize);
+    }
+    vector<WordType> product(chunkSize + bSize);
+    for(size_t offset = 0; offset < aSize; offset += chunkSize)
+    {
+        size_t size = min(chunkSize, aSize - offset);
+        WordType * p = (offset == 0 ? dest : &product[0]);
+        if(n != 0)
+        {
+            nttTransform(&chunkTransform[0], n, a + offset, size);
+            multiplyTransformed(p, size + bSize, &chunkTransform[0], &bTransform[0], n);
+        }
+        else
+            multiplyWords(p, a + offset, size, b, bSize);
+        if(offset != 0)
+        {
+            // only the low bSize words overlap the previous piece's product
+            for(size_t i = bSize; i < size + bSize; i++)
+                dest[offset + i] = product[i];
+            addWords(dest + offset, dest + offset, size + bSize, &product[0], bSize);
+        }
+    }
+}
+
+static void multiplyWords(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize) // dest must hold aSize + bSize words and not overlap a or b; a == b squares
+{
+    if(aSize < bSize)
+    {
+        swap(a, b);
+        swap(aSize, bSize);
+    }
+    if(a == b && aSize == bSize && aSize >= 2 && aSize <= FixedSquareMaxWords)
+        fixedSquareKernels[aSize](dest, a);
+    else if(aSize == bSize && a != b && aSize <= FixedMultiplyMaxWords)
+        fixedMultiplyKernels[aSize](dest, a, b);
+    else if(a == b && aSize == bSize && aSize < KaratsubaSquareThreshold)
+        squareWordsSchoolbook(dest, a, aSize);
+    else if(bSize < KaratsubaThreshold)
+        multiplyWordsSchoolbook(dest, a, aSize, b, bSize);
+#ifdef BIGMATH_SIMD_KERNELS
+    else if(useSimdSchoolbook(bSize))
+        multiplyWordsSchoolbook(dest, a, aSize, b, bSize);
+#endif
+    else if(bSize <= (aSize + 1) / 2)
+        multiplyWordsUnbalanced(dest, a, aSize, b, bSize);
+    else if(bSize >= NttThreshold && aSize + bSize <= MaxNttLength)
+        multiplyWordsNtt(dest, a, aSize, b, bSize);
+    else if(bSize >= Toom4Threshold && bSize > 3 * ((aSize + 3) / 4))
+        multiplyWordsToom4(dest, a, aSize, b, bSize);
+    else if(bSize >= Toom3Threshold && bSize > 2 * ((aSize + 2) / 3))
+        multiplyWordsToom3(dest, a, aSize, b, bSize);
+    else
+        multiplyWordsKaratsuba(dest, a, aSize, b, bSize);
+}
+
+BigUnsigned square(BigUnsigned a)
+{
+    size_t size = a.data->size;
+    if(size == 1)
+        return operator *(a, a.data->words[0]);
+    BigUnsigned retval(0, 2 * size);
+    multiplyWords(retval.data->words, a.data->words, size, a.data->words, size);
+    retval.normalize();
+    return retval;
+}
+
+BigUnsigned operator *(BigUnsigned a, BigUnsigned b)
+{
+    if(a.data == b.data)
+        return square(a);
+    if(a.data->size < b.data->size)
+        swap(a, b);
+    if(b.data->size == 1)
+        return operator *(a, b.data->words[0]);
+    BigUnsigned retval(0, a.data->size + b.data->size);
+    multiplyWords(retval.data->words, a.data->words, a.data->size, b.data->words, b.data->size);
+    retval.normalize();
+    return retval;
+}
+
+BigUnsigned operator *(BigUnsigned a, const Multiplier & b)
+{
+    size_t aSize = a.data->size, bSize = b.value.data->size;
+    size_t productSize = aSize + bSize;
+    if(min(aSize, bSize) < MultiplierNttThreshold || productSize > MaxNttLength)
+        return operator *(a, b.value);
+    size_t n = nttLength(productSize);
+    vector<WordType> & bTransform = b.transforms[n];
+    if(bTransform.empty())
+    {
+        bTransform.resize(NttPrimeCount * n);
+        nttTransform(&bTransform[0], n, b.value.data->words, bSize);
+    }
+    vector<WordType> aTransform(NttPrimeCount * n);
+    nttTransform(&aTransform[0], n, a.data->words, aSize);
+    BigUnsigned retval(0, productSize);
+    multiplyTransformed(retval.data->words, productSize, &aTransform[0], &bTransform[0], n);
+    retval.normalize();
+    return retval;
+}
+
+BigUnsigned BigUnsigned::productDifference(BigUnsigned a, BigUnsigned b, const Multiplier & c, size_t bits) // returns a - b * c, which must be below 2^bits; only needs the product modulo a little more than that
+{
+    size_t bSize = b.data->size, cSize = c.value.data->size;
+    size_t n = nttLength(bits / BitsPerWord + 2);
+    if(min(bSize, cSize) < MultiplierNttThreshold || cSize > n || n >= nttLength(bSize + cSize))
+        return a - b * c;
+    vector<WordType> & cTransform = c.transforms[n];
+    if(cTransform.empty())
+    {
+        cTransform.resize(NttPrimeCount * n);
+        nttTransform(&cTransform[0], n, c.value.data->words, cSize);
+    }
+    vector<WordType> bTransform(NttPrimeCount * n), product(n);
+    if(bSize > n)
+    {
+        foldWords(&product[0], n, b.data->words, bSize);
+        nttTransform(&bTransform[0], n, &product[0], n);
+    }
+    else
+        nttTransform(&bTransform[0], n, b.data->words, bSize);
+    multiplyTransformedWrapped(&product[0], &bTransform[0], &cTransform[0], n);
+    const WordType one = 1;
+    BigUnsigned retval(0, n);
+    WordType * words = retval.data->words;
+    foldWords(words, n, a.data->words, a.data->size);
+    if(subtractWords(words, words, n, &product[0], n))
+        subtractWords(words, words, n, &one, 1);
+    // the difference is below the modulus, so the modulus itself can only stand for 0
+    size_t i = 0;
+    while(i < n && words[i] == WordMax)
+        i++;
+    if(i == n)
+        return BigUnsigned(0);
+    retval.normalize();
+    return retval;
+}
+
+static void divMod(WordType dividend, WordType divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+{
+    if(divisor == 0)
+        handleError("division by 0 in BigUnsigned::divMod");
+    if(pquotient)
+        *pquotient = dividend / divisor;
+    if(premainder)
+        *premainder = dividend % divisor;
+}
+
+#ifdef BIGMATH_SIMD_KERNELS
+__attribute__((target("avx2"))) static size_t lshiftWordsAvx2(WordType dest[], const WordType src[], size_t size, size_t shiftCount) // does the top words and returns how many are left at the bottom
+{
+    __m128i left = _mm_cvtsi64_si128(shiftCount);
+    __m128i right = _mm_cvtsi64_si128(BitsPerWord - shiftCount);
+    size_t i = size;
+    for(; i > Avx2WordsPerVector; i -= Avx2WordsPerVector)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(src + i - Avx2WordsPerVector));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(src + i - Avx2WordsPerVector - 1));
+#ifdef BIGMATH_64BIT_WORDS
+        x = _mm256_or_si256(_mm256_sll_epi64(x, left), _mm256_srl_epi64(y, right));
+#else
+        x = _mm256_or_si256(_mm256_sll_epi32(x, left), _mm256_srl_epi32(y, right));
+#endif
+        _mm256_storeu_si256((__m256i *)(dest + i - Avx2WordsPerVector), x);
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t rshiftWordsAvx2(WordType dest[], const WordType src[], size_t size, size_t shiftCount) // does the bottom words and returns how many were done
+{
+    __m128i right = _mm_cvtsi64_si128(shiftCount);
+    __m128i left = _mm_cvtsi64_si128(BitsPerWord - shiftCount);
+    size_t i = 0;
+    for(; i + Avx2WordsPerVector < size; i += Avx2WordsPerVector)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(src + i + 1));
+#ifdef BIGMATH_64BIT_WORDS
+        x = _mm256_or_si256(_mm256_srl_epi64(x, right), _mm256_sll_epi64(y, left));
+#else
+        x = _mm256_or_si256(_mm256_srl_epi32(x, right), _mm256_sll_epi32(y, left));
+#endif
+        _mm256_storeu_si256((__m256i *)(dest + i), x);
+    }
+    return i;
+}
+#endif
+
+static void lshiftWords(WordType dest[], WordType src[], size_t size, size_t shiftCount) // dest[0:size-1] = src[0:size-1] << shiftCount without the bits shifted out of the top; dest may be src or above it
+{
+    if(shiftCount == 0)
+    {
+        if(dest == src)
+            return;
+        for(size_t i = size; i > 0; i--)
+            dest[i - 1] = src[i - 1];
+        return;
+    }
+    size_t i = size;
+#ifdef BIGMATH_SIMD_KERNELS
+    if(size >= Avx2ShiftThreshold && hasAvx2())
+        i = lshiftWordsAvx2(dest, src, size, shiftCount);
+#endif
+    WordType highWord = src[i - 1];
+    for(; i > 1; i--)
+    {
+        WordType lowWord = src[i - 2];
+        lshiftDoubleWord(highWord, lowWord, shiftCount, dest[i - 1]);
+        highWord = lowWord;
+    }
+    dest[0] = highWord << shiftCount;
+}
+
+static void rshiftWords(WordType dest[], WordType src[], size_t size, size_t shiftCount) // dest[0:size-1] = src[0:size-1] >> shiftCount; dest may be src or below it
+{
+    if(shiftCount == 0)
+    {
+        if(dest == src)
+            return;
+        for(size_t i = 0; i < size; i++)
+            dest[i] = src[i];
+        return;
+    }
+    size_t i = 0;
+#ifdef BIGMATH_SIMD_KERNELS
+    if(size >= Avx2ShiftThreshold && hasAvx2())
+        i = rshiftWordsAvx2(dest, src, size, shiftCount);
+#endif
+    WordType lowWord = src[i];
+    for(; i + 1 < size; i++)
+    {
+        WordType highWord = src[i + 1];
+        rshiftDoubleWord(highWord, lowWord, shiftCount, dest[i]);
+        lowWord = highWord;
+    }
+    dest[size - 1] = lowWord >> shiftCount;
+}
+
+static size_t countLeadingZeros(WordType v)
+{
+    size_t retval = 0;
+    while((v & ((WordType)1 << (BitsPerWord - 1))) == 0)
+    {
+        retval++;
+        v <<= 1;
+    }
+    return retval;
+}
+
+  /* Subtract x[0:len-1]*y from dest[offset:offset+len-1]. from http://www.opensource.apple.com/source/gcc/gcc-5484/libjava/gnu/java/math/MPN.java
+   * All values are treated as if unsigned.
+   * @return the most significant word of
+   * the product, minus borrow-out from the subtraction.
+   */
+static WordType submul_1(WordType dest[], size_t offset, const WordType x[], size_t len, WordType y)
+{
+    WordType carry = 0;
+    size_t j = 0;
+    do
+    {
+        WordType prod_low;
+        multiplyDoubleWordAndAdd(y, x[j], carry, carry, prod_low);
+        WordType x_j = dest[offset + j];
+        prod_low = x_j - prod_low;
+        carry += prod_low > x_j; // a branch here mispredicts on every other word
+        dest[offset + j] = prod_low;
+    }
+    while (++j < len);
+    return carry;
+}
+
+
+ /** Divide zds[0:nx] by y[0:ny-1]. from http://www.opensource.apple.com/source/gcc/gcc-5484/libjava/gnu/java/math/MPN.java
+   * The remainder ends up in zds[0:ny-1].
+   * The quotient ends up in zds[ny:nx].
+   * Assumes:  nx>ny.
+   * (int)y[ny-1] < 0  (i.e. most significant bit set)
+   */
+
+static void divide(WordType zds[], size_t nx, const WordType y[], size_t ny)
+{
+    // This is basically Knuth's formulation of the classical algorithm,
+    // but translated from in scm_divbigbig in Jaffar's SCM implementation.
+
+    // Correspondance with Knuth's notation:
+    // Knuth's u[0:m+n] == zds[nx:0].
+    // Knuth's v[1:n] == y[ny-1:0]
+    // Knuth's n == ny.
+    // Knuth's m == nx-ny.
+    // Our nx == Knuth's m+n.
+
+    // Could be re-implemented using gmp's mpn_divrem:
+    // zds[nx] = mpn_divrem (&zds[ny], 0, zds, nx, y, ny).
+
+    size_t j = nx;
+    do
+    {                          // loop over digits of quotient
+        // Knuth's j == our nx-j.
+        // Knuth's u[j:j+n] == our zds[j:j-ny].
+        WordType qhat;
+        if(zds[j] == y[ny - 1])
+            qhat = WordMax;
+        else
+        {
+            WordType remainder;
+            divideDoubleWord(zds[j], zds[j - 1], y[ny - 1], qhat, remainder);
+            if(ny >= 2)
+            {
+                // Knuth's step D3: the next divisor word shows whether qhat is too big, which makes the add back
+                // below rare instead of happening for a large share of the quotient words
+                WordType productHigh, productLow;
+                multiplyDoubleWord(qhat, y[ny - 2], productHigh, productLow);
+                while(productHigh > remainder || (productHigh == remainder && productLow > zds[j - 2]))
+                {
+                    qhat--;
+                    remainder += y[ny - 1];
+                    if(remainder < y[ny - 1])
+                        break; // the remainder doesn't fit in a word any more, so the test can't succeed
+                    if(productLow < y[ny - 2])
+                        productHigh--;
+                    productLow -= y[ny - 2];
+                }
+            }
+        }
+        if(qhat != 0)
+        {
+            WordType borrow = submul_1(zds, j - ny, y, ny, qhat);
+            WordType save = zds[j];
+            if(save != borrow)
+            {
+                bool carry;
+                do
+                {
+                    qhat--;
+                    carry = addWords(zds + j - ny, zds + j - ny, ny, y, ny);
+                    if(carry)
+                        zds[j]++;
+                }
+                while(!carry);
+            }
+        }
+        zds[j] = qhat;
+    }
+    while (--j >= ny);
+}
+
+/* Burnikel-Ziegler recursive division, in the form GMP uses for mpn_dcpi1_div_qr.  A 2n / n word division is
+ * done as two 3/2 divisions by the top half of the divisor: the top half recursively, then one multiplication by
+ * the bottom half to fix the partial remainder, decrementing the quotient while that goes negative (at most twice).
+ * That costs about 2 M(n/2) + 2 D(n/2), so division inherits the speed of the multiplication kernels.
+ * The divisor must be normalized (top bit set); divide() does the small cases.
+ */
+static const size_t BurnikelZieglerThreshold = 40;
+
+static WordType divideWordsSchoolbook(WordType quotient[], WordType numerator[], size_t size, const WordType divisor[]) // divides numerator[0:2*size-1] by divisor[0:size-1]; quotient gets size words, the remainder replaces numerator[0:size-1] and the top quotient word (0 or 1) is returned
+{
+    WordType quotientHigh = 0;
+    if(compareWords(numerator + size, size, divisor, size) >= 0)
+    {
+        subtractWords(numerator + size, numerator + size, size, divisor, size);
+        quotientHigh = 1;
+    }
+    if(size == 1)
+    {
+        divideDoubleWord(numerator[1], numerator[0], divisor[0], quotient[0], numerator[0]);
+        return quotientHigh;
+    }
+    divide(numerator, 2 * size - 1, divisor, size);
+    for(size_t i = 0; i < size; i++)
+    {
+        quotient[i] = numerator[size + i];
+    }
+    return quotientHigh;
+}
+
+static WordType divideWordsBalanced(WordType quotient[], WordType numerator[], size_t size, const WordType divisor[], WordType scratch[]) // same as divideWordsSchoolbook; scratch holds size words
+{
+    if(size < BurnikelZieglerThreshold)
+        return divideWordsSchoolbook(quotient, numerator, size, divisor);
+    const WordType one = 1;
+    size_t lowSize = size / 2, highSize = size - lowSize;
+    WordType quotientHigh = divideWordsBalanced(quotient + lowSize, numerator + 2 * lowSize, highSize, divisor + lowSize, scratch);
+    multiplyWords(scratch, quotient + lowSize, highSize, divisor, lowSize);
+    WordType borrow = subtractWords(numerator + lowSize, numerator + lowSize, size, scratch, size);
+    if(quotientHigh != 0)
+        borrow += subtractWords(numerator + size, numerator + size, lowSize, divisor, lowSize);
+    while(borrow != 0)
+    {
+        quotientHigh -= subtractWords(quotient + lowSize, quotient + lowSize, highSize, &one, 1);
+        borrow -= addWords(numerator + lowSize, numerator + lowSize, size, divisor, size);
+    }
+    WordType quotientLow = divideWordsBalanced(quotient, numerator + highSize, lowSize, divisor + highSize, scratch);
+    multiplyWords(scratch, divisor, highSize, quotient, lowSize);
+    borrow = subtractWords(numerator, numerator, size, scratch, size);
+    if(quotientLow != 0)
+        borrow += subtractWords(numerator + lowSize, numerator + lowSize, highSize, divisor, highSize);
+    while(borrow != 0)
+    {
+        subtractWords(quotient, quotient, lowSize, &one, 1);
+        borrow -= addWords(numerator, numerator, size, divisor, size);
+    }
+    return quotientHigh;
+}
+
+static WordType divideWordsBlock(WordType quotient[], WordType numerator[], size_t quotientSize, const WordType divisor[], size_t divisorSize, WordType scratch[]) // divides numerator[0:quotientSize+divisorSize-1] by divisor for quotientSize <= divisorSize; otherwise like divideWordsBalanced
+{
+    size_t lowSize = divisorSize - quotientSize;
+    WordType quotientHigh = divideWordsBalanced(quotient, numerator + lowSize, quotientSize, divisor + lowSize, scratch);
+    if(lowSize == 0)
+        return quotientHigh;
+    const WordType one = 1;
+    multiplyWords(scratch, quotient, quotientSize, divisor, lowSize);
+    WordType borrow = subtractWords(numerator, numerator, divisorSize, scratch, divisorSize);
+    if(quotientHigh != 0)
+        borrow += subtractWords(numerator + quotientSize, numerator + quotientSize, lowSize, divisor, lowSize);
+    while(borrow != 0)
+    {
+        quotientHigh -= subtractWords(quotient, quotient, quotientSize, &one, 1);
+        borrow -= addWords(numerator, numerator, divisorSize, divisor, divisorSize);
+    }
+    return quotientHigh;
+}
+
+static void divideWordsRecursive(WordType quotient[], WordType numerator[], size_t numeratorSize, const WordType divisor[], size_t divisorSize) // quotient gets numeratorSize - divisorSize + 1 words, the remainder replaces numerator[0:divisorSize-1]
+{
+    vector<WordType> scratch(divisorSize);
+    size_t quotientSize = numeratorSize - divisorSize;
+    // the top block takes what is left over from whole divisor-sized blocks; every later block divides the previous remainder
+    size_t offset = quotientSize - ((quotientSize - 1) % divisorSize + 1);
+    quotient[quotientSize] = divideWordsBlock(quotient + offset, numerator + offset, quotientSize - offset, divisor, divisorSize, &scratch[0]);
+    while(offset != 0)
+    {
+        offset -= divisorSize;
+        divideWordsBlock(quotient + offset, numerator + offset, divisorSize, divisor, divisorSize, &scratch[0]);
+    }
+}
+
+size_t BigUnsigned::bitLength() const
+{
+    WordType topWord = data->words[data->size - 1];
+    if(topWord == 0)
+        return 0;
+    return data->size * BitsPerWord - countLeadingZeros(topWord);
+}
+
+/* Newton-Raphson division.  reciprocal() finds X = 2^(2k) / D for a k bit divisor from the reciprocal of its top
+ * k / 2 + NewtonGuardBits bits, with one Newton step X + X * (2^(2k) - D * X) / 2^(2k) that doubles the number of
+ * correct bits.  Every step rounds down, so X never exceeds the true reciprocal and is at most a few units below it.
+ * A quotient of a number below 2^(2k) is then its top half times X, which is corrected by adding D back in while the
+ * remainder is too big.  Both D * X and the quotient times D are known to be within a few D of a power of 2 or of
+ * the dividend, so productDifference() only computes them modulo 2^(k + BitsPerWord) - 1, at half the transform
+ * length.  The transforms of D and X are kept in Multipliers, so dividing a long number by D reuses them for every
+ * block of the quotient.
+ */
+static const size_t NewtonDivisionThreshold = 30000;
+static const size_t NewtonQuotientRatio = 3;
+static const size_t NewtonBalancedDivisionThreshold = 80000;
+static const size_t NewtonGuardBits = 32;
+
+static bool useNewtonDivision(size_t dividendSize, size_t divisorSize)
+{
+    size_t quotientSize = dividendSize - divisorSize;
+    // a long quotient reuses the reciprocal and the cached transforms for every block; a single block needs a bigger divisor to win
+    if(divisorSize >= NewtonDivisionThreshold && quotientSize >= NewtonQuotientRatio * divisorSize)
+        return true;
+    return divisorSize >= NewtonBalancedDivisionThreshold && quotientSize >= NewtonBalancedDivisionThreshold / 2;
+}
+
+BigUnsigned BigUnsigned::reciprocal(BigUnsigned divisor, size_t bits) // returns at most 2^(2*bits) / divisor and at most a few units less; divisor has bits bits
+{
+    if(divisor.data->size < NewtonDivisionThreshold)
+        return (BigUnsigned(1) << 2 * bits) / divisor;
+    size_t topBits = bits / 2 + NewtonGuardBits;
+    BigUnsigned top = (divisor >> (bits - topBits)) + (WordType)1; // rounded up, so the estimate stays below the reciprocal
+    size_t topReciprocalBits = top.bitLength(); // one more than topBits if rounding carried out of the top
+    BigUnsigned topReciprocal = reciprocal(top, topReciprocalBits);
+    size_t shiftCount = bits + topBits - 2 * topReciprocalBits; // topReciprocal << shiftCount estimates 2^(2*bits) / divisor
+    BigUnsigned error = productDifference(BigUnsigned(1) << (2 * bits - shiftCount), topReciprocal, Multiplier(divisor), bits + BitsPerWord);
+    // the low bits of error change the correction by less than 1/2, and dropping them halves the multiplication
+    size_t truncation = 2 * bits - 2 * shiftCount - topReciprocalBits - 2;
+    return (topReciprocal << shiftCount) + ((topReciprocal * (error >> truncation)) >> (topReciprocalBits + 2));
+}
+
+void BigUnsigned::divModNewton(BigUnsigned dividend, const Multiplier & divisor, const Multiplier & divisorReciprocal, BigUnsigned * pquotient, BigUnsigned * premainder) // divisorReciprocal holds reciprocal(divisor, its bit length)
+{
+    BigUnsigned divisorValue = divisor.getValue();
+    size_t bits = divisorValue.bitLength();
+    // divides from the top bits at a time, so each step divides a number below 2^(2*bits)
+    size_t position = dividend.bitLength();
+    position = position > 2 * bits ? position - 2 * bits : 0;
+    BigUnsigned quotient, remainder = dividend >> position;
+    for(;;)
+    {
+        BigUnsigned stepQuotient = ((remainder >> (bits - 1)) * divisorReciprocal) >> (bits + 1);
+        remainder = productDifference(remainder, stepQuotient, divisor, bits + BitsPerWord);
+        while(remainder >= divisorValue)
+        {
+            remainder -= divisorValue;
+            stepQuotient += (WordType)1;
+        }
+        quotient += stepQuotient;
+        if(position == 0)
+            break;
+        size_t step = min(position, bits);
+        position -= step;
+        BigUnsigned nextBits = (dividend >> position) - ((dividend >> (position + step)) << step);
+        remainder = (remainder << step) + nextBits;
+        quotient <<= step;
+    }
+    if(pquotient)
+        pquotient->swap(quotient);
+    if(premainder)
+        premainder->swap(remainder);
+}
+
+void BigUnsigned::divMod(BigUnsigned dividend, BigUnsigned divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+{
+    if(dividend.data->size == 1 && divisor.data->size == 1)
+    {
+        ::divMod(dividend.data->words[0], divisor.data->words[0], pquotient, premainder);
+        return;
+    }
+    else if(dividend.data->size == 1)
+    {
+        divMod(dividend.data->words[0], divisor, pquotient, premainder);
+        return;
+    }
+    else if(divisor.data->size == 1)
+    {
+        divMod(dividend, divisor.data->words[0], pquotient, premainder);
+        return;
+    }
+    if(dividend < divisor)
+    {
+        if(pquotient)
+            *pquotient = 0;
+        if(premainder)
+            *premainder = dividend;
+        return;
+    }
+    if(dividend == divisor)
+    {
+        if(pquotient)
             *pquotient = 1;
         if(premainder)
             *premainder = 0;
         return;
     }
-    size_t normalizationShift = countLeadingZeros(divisor.data->words[divisor.data->size - 1]);
-    dividend.onWrite();
-    if(normalizationShift != 0)
+    if(useNewtonDivision(dividend.data->size, divisor.data->size))
+    {
+        divModNewton(dividend, Multiplier(divisor), Multiplier(reciprocal(divisor, divisor.bitLength())), pquotient, premainder);
+        return;
+    }
+    size_t normalizationShift = countLeadingZeros(divisor.data->words[divisor.data->size - 1]);
+    if(normalizationShift != 0)
+    {
+        divisor.onWrite();
+        lshiftWords(divisor.data->words, divisor.data->words, divisor.data->size, normalizationShift);
+    }
+    divModNormalized(dividend, divisor, normalizationShift, pquotient, premainder);
+}
+
+void BigUnsigned::divModNormalized(BigUnsigned dividend, BigUnsigned divisor, size_t normalizationShift, BigUnsigned * pquotient, BigUnsigned * premainder) // divisor is already shifted left by normalizationShift and dividend is at least as big as the real divisor
+{
+    dividend.onWrite();
+    if(normalizationShift != 0)
+    {
+        dividend.data->expand(dividend.data->size + 2);
+        lshiftWords(dividend.data->words, dividend.data->words, dividend.data->size - 1, normalizationShift);
+    }
+    else if(dividend.data->size == divisor.data->size)
+    {
+        dividend.data->expand(dividend.data->size + 2);
+    }
+    else
+    {
+        dividend.data->expand(dividend.data->size + 1);
+    }
+    size_t remainderSize = divisor.data->size;
+    size_t quotientSize = dividend.data->size - divisor.data->size;
+    if(remainderSize >= BurnikelZieglerThreshold && quotientSize >= BurnikelZieglerThreshold)
+    {
+        // leaves the quotient where divide() would, above the remainder; the padding word keeps its top word 0
+        vector<WordType> quotient(quotientSize + 1);
+        divideWordsRecursive(&quotient[0], dividend.data->words, dividend.data->size, divisor.data->words, remainderSize);
+        for(size_t i = 0; i < quotientSize; i++)
+        {
+            dividend.data->words[remainderSize + i] = quotient[i];
+        }
+    }
+    else
+        divide(dividend.data->words, dividend.data->size - 1, divisor.data->words, divisor.data->size);
+    if(premainder)
+    {
+        BigUnsigned & remainder = *premainder;
+        remainder.onWrite();
+        remainder.data->resize(remainderSize);
+        rshiftWords(remainder.data->words, dividend.data->words, remainderSize, normalizationShift);
+        remainder.normalize();
+    }
+    if(pquotient)
+    {
+        BigUnsigned & quotient = *pquotient;
+        quotient.onWrite();
+        quotient.data->resize(quotientSize);
+        for(size_t i = 0; i < quotientSize; i++)
+        {
+            quotient.data->words[i] = dividend.data->words[i + divisor.data->size];
+        }
+        quotient.normalize();
+    }
+}
+
+void BigUnsigned::divMod(WordType dividend, BigUnsigned divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+{
+    if(divisor.data->size == 1)
+    {
+        ::divMod(dividend, divisor.data->words[0], pquotient, premainder);
+        return;
+    }
+    if(pquotient)
+        *pquotient = 0;
+    if(premainder)
+        *premainder = dividend;
+}
+
+static const size_t PreinvertedDivisionThreshold = 4; // finding the reciprocal costs about one hardware division
+
+void BigUnsigned::divMod(BigUnsigned dividend, WordType divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+{
+    if(divisor == 0)
+        handleError("division by 0 in BigUnsigned::divMod");
+    if(divisor == 1)
+    {
+        if(premainder)
+            *premainder = 0;
+        if(pquotient)
+            *pquotient = dividend;
+        return;
+    }
+    if(dividend.data->size == 1)
+    {
+        ::divMod(dividend.data->words[0], divisor, pquotient, premainder);
+        return;
+    }
+    if(dividend.data->size == 2)
+    {
+        WordType highWord = dividend.data->words[1];
+        if(highWord < divisor)
+        {
+            WordType lowWord = dividend.data->words[0];
+            WordType quotient;
+            WordType remainder;
+            divideDoubleWord(highWord, lowWord, divisor, quotient, remainder);
+            if(pquotient)
+                *pquotient = quotient;
+            if(premainder)
+                *premainder = remainder;
+            return;
+        }
+    }
+    if(dividend.data->size >= PreinvertedDivisionThreshold)
+    {
+        size_t normalizationShift = countLeadingZeros(divisor);
+        divisor <<= normalizationShift;
+        divModPreinverted(dividend, divisor, normalizationShift, reciprocalWord(divisor), pquotient, premainder);
+        return;
+    }
+    if(!pquotient)
+    {
+        WordType remainder = 0, quotient;
+        for(size_t i = 0, j = dividend.data->size - 1; i < dividend.data->size; i++, j--)
+        {
+            divideDoubleWord(remainder, dividend.data->words[j], divisor, quotient, remainder);
+        }
+        if(premainder)
+            *premainder = remainder;
+        return;
+    }
+    BigUnsigned & quotient = *pquotient;
+    quotient.onWrite();
+    quotient.data->expand(dividend.data->size);
+    WordType remainder = 0;
+    for(size_t i = 0, j = dividend.data->size - 1; i < dividend.data->size; i++, j--)
+    {
+        divideDoubleWord(remainder, dividend.data->words[j], divisor, quotient.data->words[j], remainder);
+    }
+    if(premainder)
+        *premainder = remainder;
+    quotient.normalize();
+}
+
+void BigUnsigned::divModPreinverted(BigUnsigned dividend, WordType divisor, size_t normalizationShift, WordType reciprocal, BigUnsigned * pquotient, BigUnsigned * premainder) // divisor is already shifted left by normalizationShift
+{
+    if(!pquotient)
+    {
+        WordType remainder = divideWordsByWordPreinverted(NULL, dividend.data->words, dividend.data->size, divisor, normalizationShift, reciprocal);
+        if(premainder)
+            *premainder = remainder;
+        return;
+    }
+    BigUnsigned & quotient = *pquotient;
+    quotient.onWrite();
+    quotient.data->expand(dividend.data->size);
+    WordType remainder = divideWordsByWordPreinverted(quotient.data->words, dividend.data->words, dividend.data->size, divisor, normalizationShift, reciprocal);
+    if(premainder)
+        *premainder = remainder;
+    quotient.normalize();
+}
+
+Divisor::Divisor(BigUnsigned value)
+    : value(value), normalized(value), normalizationShift(0), reciprocal(0), valueMultiplier(value), reciprocalMultiplier(BigUnsigned(0))
+{
+    if(!value)
+        handleError("division by 0 in Divisor::Divisor");
+    size_t size = value.data->size;
+    normalizationShift = countLeadingZeros(value.data->words[size - 1]);
+    if(size == 1)
+    {
+        reciprocal = reciprocalWord(value.data->words[0] << normalizationShift);
+        return;
+    }
+    if(normalizationShift != 0)
+    {
+        normalized.onWrite();
+        lshiftWords(normalized.data->words, normalized.data->words, size, normalizationShift);
+    }
+}
+
+void BigUnsigned::divMod(BigUnsigned dividend, const Divisor & divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+{
+    size_t divisorSize = divisor.value.data->size;
+    if(divisorSize == 1)
+    {
+        WordType divisorWord = divisor.value.data->words[0];
+        if(dividend.data->size == 1)
+            ::divMod(dividend.data->words[0], divisorWord, pquotient, premainder);
+        else
+            divModPreinverted(dividend, divisorWord << divisor.normalizationShift, divisor.normalizationShift, divisor.reciprocal, pquotient, premainder);
+        return;
+    }
+    if(dividend < divisor.value)
+    {
+        if(pquotient)
+            *pquotient = 0;
+        if(premainder)
+            *premainder = dividend;
+        return;
+    }
+    if(useNewtonDivision(dividend.data->size, divisorSize))
+    {
+        if(!divisor.reciprocalMultiplier.getValue())
+            divisor.reciprocalMultiplier = Multiplier(reciprocal(divisor.value, divisor.value.bitLength()));
+        divModNewton(dividend, divisor.valueMultiplier, divisor.reciprocalMultiplier, pquotient, premainder);
+        return;
+    }
+    divModNormalized(dividend, divisor.normalized, divisor.normalizationShift, pquotient, premainder);
+}
+
+static const size_t BarrettMinWords = 2;
+static const size_t BarrettMaxShortWords = 12;
+static const size_t BarrettMinLongWords = 1024;
+
+static void multiplyWordsHigh(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize, size_t skip) // like multiplyWordsSchoolbook, but leaves out the partial products below word skip, which leaves dest less than aSize * W^(skip + 1) low
+{
+    for(size_t i = 0; i < aSize + bSize; i++)
+        dest[i] = 0;
+    for(size_t i = 0; i < aSize; i++)
+    {
+        size_t start = skip > i ? min(skip - i, bSize) : 0;
+        dest[i + bSize] = addmul_1(dest + i + start, b + start, bSize - start, a[i]);
+    }
+}
+
+static void multiplyWordsLow(WordType dest[], const WordType a[], size_t aSize, const WordType b[], size_t bSize, size_t size) // dest[0:size-1] = a * b mod W^size
+{
+    for(size_t i = 0; i < size; i++)
+        dest[i] = 0;
+    for(size_t i = 0; i < min(aSize, size); i++)
+    {
+        size_t length = min(bSize, size - i);
+        WordType carry = addmul_1(dest + i, b, length, a[i]);
+        if(i + length < size)
+            dest[i + length] = carry;
+    }
+}
+
+BarrettReducer::BarrettReducer(BigUnsigned modulus)
+    : modulus(modulus), size(modulus.data->size), modulusMultiplier(modulus), reciprocalMultiplier(BigUnsigned(0))
+{
+    if(!modulus)
+        handleError("division by 0 in BarrettReducer::BarrettReducer");
+    reciprocal = (BigUnsigned(1) << 2 * size * BitsPerWord) / modulus; // size + 1 words, or size + 2 for m = W^(size - 1)
+    reciprocalMultiplier = Multiplier(reciprocal);
+    scratch.resize(2 * (size + 1 + reciprocal.data->size)); // the top of v times mu, then the quotient times m
+}
+
+BigUnsigned BarrettReducer::reduce(BigUnsigned v) const
+{
+    size_t vSize = v.data->size;
+    if(vSize > 2 * size)
+        return v % modulus;
+    if(vSize < size)
+        return v;
+    // the estimate of v / m from the top words is at most 2 low, so the remainder is below 3 * m and only its low
+    // size + 1 words need working out
+    if(size >= MultiplierNttThreshold)
+    {
+        BigUnsigned quotient = ((v >> (size - 1) * BitsPerWord) * reciprocalMultiplier) >> (size + 1) * BitsPerWord;
+        BigUnsigned retval = BigUnsigned::productDifference(v, quotient, modulusMultiplier, (size + 1) * BitsPerWord);
+        while(retval >= modulus)
+            retval -= modulus;
+        return retval;
+    }
+    size_t topSize = vSize - (size - 1), reciprocalSize = reciprocal.data->size;
+    WordType * product = &scratch[0];
+    const WordType * quotient = product + size + 1;
+    size_t quotientSize = topSize + reciprocalSize - (size + 1);
+    WordType * quotientProduct = product + topSize + reciprocalSize;
+    if(size < KaratsubaThreshold)
+    {
+        // short enough for schoolbook products, so only the words that matter get worked out; the estimate can be
+        // one lower still
+        multiplyWordsHigh(product, v.data->words + size - 1, topSize, reciprocal.data->words, reciprocalSize, size - 1);
+        multiplyWordsLow(quotientProduct, quotient, quotientSize, modulus.data->words, size, size + 1);
+    }
+    else
+    {
+        multiplyWords(product, v.data->words + size - 1, topSize, reciprocal.data->words, reciprocalSize);
+        multiplyWords(quotientProduct, quotient, quotientSize, modulus.data->words, size);
+    }
+    BigUnsigned retval(0, size + 1);
+    WordType * words = retval.data->words;
+    for(size_t i = 0; i < min(vSize, size + 1); i++)
+        words[i] = v.data->words[i];
+    subtractWords(words, words, size + 1, quotientProduct, min(quotientSize + size, size + 1));
+    while(compareWords(words, size + 1, modulus.data->words, size) >= 0)
+        subtractWords(words, words, size + 1, modulus.data->words, size);
+    retval.normalize();
+    return retval;
+}
+
+/* Special-form moduli : for m = 2^bits - c, 2^bits = c mod m, so the bits of a number above bit `bits` can be
+ * multiplied by c and added back to the bits below, which takes off about bits - bitLength(c) bits at a time.  With
+ * c no longer than half of m, a product of two reduced numbers is down below 2^bits after two or three of these folds
+ * and below m after one subtraction, so all it costs is a product by c : a single addmul_1 pass for one word
+ * constants like the 19 of 2^255 - 19, and only a mask for a power of two.  Montgomery reduction costs about as much
+ * as a fold for odd moduli below SpecialFormMinBits, so those stay with it.
+ */
+
+static const size_t SpecialFormRowsMaxWords = 8;
+static const size_t SpecialFormMinBits = 512;
+
+static bool findSpecialForm(const BigUnsigned & modulus, size_t & bits, BigUnsigned & term) // modulus = 2^bits - term with a term short enough to be worth folding; modulus must be more than 1
+{
+    bits = modulus.bitLength();
+    if(!((modulus - BigUnsigned(1)) & modulus))
+    {
+        bits--;
+        term = 0;
+        return true;
+    }
+    term = (BigUnsigned(1) << bits) - modulus;
+    return term.bitLength() <= bits / 2 + 1;
+}
+
+static bool useSpecialForm(const BigUnsigned & modulus, size_t & bits, BigUnsigned & term) // false for 0 and 1, which are left to the usual errors
+{
+    return modulus > (WordType)1 && findSpecialForm(modulus, bits, term) && (!modulus.testBit(0) || bits >= SpecialFormMinBits);
+}
+
+static size_t foldSpecialForm(WordType v[], size_t vSize, size_t bits, const WordType term[], size_t termSize, WordType scratch[]) // v = v mod 2^bits - term, returned with its size, given that term is below 2^bits; v needs room for vSize + termSize + 1 words and scratch for 2 * (vSize + termSize) words; termSize may be 0 for a term of 0
+{
+    size_t shiftWords = bits / BitsPerWord, shiftBits = bits % BitsPerWord;
+    while(vSize > 1 && v[vSize - 1] == 0)
+        vSize--;
+    while(vSize > shiftWords && (vSize > shiftWords + 1 || (v[shiftWords] >> shiftBits) != 0))
+    {
+        // v = (v mod 2^bits) + (v >> bits) * term, which leaves v mod m alone since 2^bits = term mod m
+        size_t highSize = vSize - shiftWords;
+        WordType * high = scratch, * product = scratch + highSize;
+        rshiftWords(high, v + shiftWords, highSize, shiftBits);
+        while(highSize > 1 && high[highSize - 1] == 0)
+            highSize--;
+        vSize = shiftWords;
+        if(shiftBits != 0)
+            v[vSize++] &= ((WordType)1 << shiftBits) - 1;
+        if(termSize != 0)
+        {
+            size_t productSize = highSize + termSize, sumSize = max(vSize, productSize) + 1;
+            for(size_t i = vSize; i < sumSize; i++)
+                v[i] = 0;
+            if(termSize <= SpecialFormRowsMaxWords)
+            {
+                // a row at a time straight into v, leaving out the 0 words of sparse terms like 2^224 + 1
+                for(size_t i = 0; i < termSize; i++)
+                {
+                    if(term[i] != 0)
+                        addmulWords(v + i, sumSize - i, high, highSize, term[i]);
+                }
+            }
+            else
+            {
+                multiplyWords(product, high, highSize, term, termSize);
+                addWords(v, v, sumSize, product, productSize);
+            }
+            vSize = sumSize;
+        }
+        while(vSize > 1 && v[vSize - 1] == 0)
+            vSize--;
+    }
+    return vSize;
+}
+
+static void reduceSpecialForm(WordType dest[], WordType v[], size_t vSize, size_t bits, const WordType term[], size_t termSize, const WordType modulus[], size_t size, WordType scratch[]) // dest[0:size-1] = v mod modulus for a modulus = 2^bits - term of size words; v and scratch as for foldSpecialForm, and v is overwritten
+{
+    // below 2^bits is below 2 * modulus
+    vSize = foldSpecialForm(v, vSize, bits, term, termSize, scratch);
+    copy(v, v + vSize, dest);
+    fill(dest + vSize, dest + size, 0);
+    if(compareWords(dest, size, modulus, size) >= 0)
+        subtractWords(dest, dest, size, modulus, size);
+}
+
+SpecialFormReducer::SpecialFormReducer(BigUnsigned modulus)
+    : modulus(modulus), size(modulus.data->size)
+{
+    if(modulus <= (WordType)1 || !findSpecialForm(modulus, bits, term))
+        handleError("modulus is not 2^k - c for a short c in SpecialFormReducer::SpecialFormReducer");
+    scratch.resize(3 * (2 * size + term.data->size + 1));
+}
+
+SpecialFormReducer::SpecialFormReducer(size_t bits, BigUnsigned term)
+    : term(term), bits(bits)
+{
+    if(term.bitLength() >= bits || (BigUnsigned(1) << bits) - term == (WordType)1)
+        handleError("2^bits - term must be more than 1 and term below 2^(bits - 1) in SpecialFormReducer::SpecialFormReducer");
+    modulus = (BigUnsigned(1) << bits) - term;
+    size = modulus.data->size;
+    scratch.resize(3 * (2 * size + term.data->size + 1));
+}
+
+bool SpecialFormReducer::isSpecialForm(BigUnsigned modulus)
+{
+    size_t bits;
+    BigUnsigned term;
+    return modulus > (WordType)1 && findSpecialForm(modulus, bits, term);
+}
+
+BigUnsigned SpecialFormReducer::reduce(BigUnsigned v) const
+{
+    size_t vSize = v.data->size, termSize = !term ? 0 : term.data->size;
+    if(vSize > 2 * size)
+        return v % modulus;
+    if(vSize < size)
+        return v;
+    size_t capacity = vSize + termSize + 1;
+    WordType * words = &scratch[0];
+    copy(v.data->words, v.data->words + vSize, words);
+    BigUnsigned retval(0, size);
+    reduceSpecialForm(retval.data->words, words, vSize, bits, term.data->words, termSize, modulus.data->words, size, words + capacity);
+    retval.normalize();
+    return retval;
+}
+
+/* Exact division (Jebelean) : when b is known to divide a, the quotient is a * b^-1 modulo W^size, W = 2^BitsPerWord,
+ * for a quotient of size words, so it can be found from the bottom up without any division or correction steps, and
+ * only the low size words of a and b take part.  The schoolbook loop takes one quotient word at a time from the
+ * bottom word of what is left of a and the inverse of the bottom word of b; long quotients split in halves like
+ * Burnikel-Ziegler division does.  Past ExactDivisionBidirectionalThreshold words only the low half of the quotient
+ * is found this way and the high half comes from an ordinary division of the top words, so each side does a
+ * problem of half the size.
+ */
+
+static const size_t ExactDivisionRecursiveThreshold = 150;
+static const size_t ExactDivisionBidirectionalThreshold = 150;
+
+static size_t countTrailingZeros(WordType v) // v must not be 0
+{
+    size_t retval = 0;
+    while((v & 1) == 0)
+    {
+        retval++;
+        v >>= 1;
+    }
+    return retval;
+}
+
+static void exactDivideWordsSchoolbook(WordType quotient[], WordType a[], size_t size, const WordType b[], size_t bSize) // quotient[0:size-1] = a / b modulo W^size; a[0:size-1] is overwritten; b must be odd
+{
+    WordType inverse = inverseModWord(b[0]);
+    for(size_t i = 0; i < size; i++)
+    {
+        WordType q = a[i] * inverse;
+        quotient[i] = q;
+        // the borrow out of the top of a only matters above the quotient, so it is dropped
+        WordType borrow = submul_1(a, i, b, min(bSize, size - i), q);
+        if(i + bSize < size)
+            subtractWords(a + i + bSize, a + i + bSize, size - i - bSize, &borrow, 1);
+    }
+}
+
+static void exactDivideWords(WordType quotient[], WordType a[], size_t size, const WordType b[], size_t bSize) // same as exactDivideWordsSchoolbook
+{
+    if(size < ExactDivisionRecursiveThreshold || bSize < ExactDivisionRecursiveThreshold)
+    {
+        exactDivideWordsSchoolbook(quotient, a, size, b, bSize);
+        return;
+    }
+    size_t lowSize = size / 2, highSize = size - lowSize;
+    exactDivideWords(quotient, a, lowSize, b, bSize);
+    // takes the low half of the quotient times b off the high half of a
+    size_t bLength = min(bSize, size);
+    vector<WordType> product(lowSize + bLength);
+    multiplyWords(&product[0], quotient, lowSize, b, bLength);
+    subtractWords(a + lowSize, a + lowSize, highSize, &product[lowSize], min(highSize, bLength));
+    exactDivideWords(quotient + lowSize, a + lowSize, highSize, b, bSize);
+}
+
+BigUnsigned exactDivide(BigUnsigned dividend, BigUnsigned divisor)
+{
+    if(!divisor)
+        handleError("division by 0 in exactDivide");
+#ifndef NDEBUG
+    BigUnsigned originalDividend = dividend, originalDivisor = divisor;
+#endif
+    // strip the factors of 2 first, which leaves an odd divisor
+    size_t zeroWords = 0;
+    while(divisor.data->words[zeroWords] == 0)
+        zeroWords++;
+    size_t shiftCount = zeroWords * BitsPerWord + countTrailingZeros(divisor.data->words[zeroWords]);
+    if(shiftCount != 0)
+    {
+        dividend >>= shiftCount;
+        divisor >>= shiftCount;
+    }
+    BigUnsigned retval;
+    if(divisor.data->size <= dividend.data->size)
+    {
+        size_t size = dividend.data->size - divisor.data->size + 1, divisorSize = divisor.data->size;
+        size_t lowSize = size, highSize = 0;
+        BigUnsigned highQuotient;
+        if(size >= ExactDivisionBidirectionalThreshold)
+        {
+            // the top half of the quotient only depends on the top words of the operands, so it comes from an
+            // ordinary division of those, which can be a few units low or high; one overlapping word from the
+            // bottom up part fixes it
+            highSize = size - size / 2;
+            lowSize = size - highSize;
+            size_t topSize = highSize + 2;
+            size_t dropSize = divisorSize > topSize ? divisorSize - topSize : 0;
+            highQuotient = (dividend >> (dropSize + lowSize) * BitsPerWord) / (divisor >> dropSize * BitsPerWord);
+        }
+        dividend.onWrite();
+        retval = BigUnsigned(0, size + 1);
+        WordType * words = retval.data->words;
+        exactDivideWords(words, dividend.data->words, min(lowSize + 1, size), divisor.data->words, divisorSize);
+        if(highSize != 0)
+        {
+            WordType error = highQuotient.data->words[0] - words[lowSize];
+            if(error < WordMax / 2)
+                highQuotient -= error;
+            else
+                highQuotient += -error;
+            for(size_t i = 0; i < min(highSize + 1, highQuotient.data->size); i++)
+                words[lowSize + i] = highQuotient.data->words[i];
+        }
+        retval.normalize();
+    }
+#ifndef NDEBUG
+    if(retval * originalDivisor != originalDividend)
+        handleError("division is not exact in exactDivide");
+#endif
+    return retval;
+}
+
+/* Sliding window exponentiation : the exponent is read from the top, and every run of up to windowBits bits that
+ * starts and ends with a set bit costs one multiplication by a precomputed odd power of the base, after squaring
+ * once per bit.  The bits in between runs only cost a squaring each.
+ */
+
+static size_t getWindowBits(size_t exponentBits) // the table of odd powers has 2^(windowBits - 1) entries
+{
+    if(exponentBits > 671)
+        return 6;
+    if(exponentBits > 239)
+        return 5;
+    if(exponentBits > 79)
+        return 4;
+    if(exponentBits > 23)
+        return 3;
+    return 1;
+}
+
+static size_t getWindow(const BigUnsigned & exponent, size_t top, size_t windowBits, size_t & value) // bit top - 1 of exponent must be set; returns the length of the window and sets value to its bits
+{
+    size_t length = min(windowBits, top);
+    while(!exponent.testBit(top - length))
+        length--;
+    value = 0;
+    for(size_t i = 1; i <= length; i++)
+        value = 2 * value + (exponent.testBit(top - i) ? 1 : 0);
+    return length;
+}
+
+BigUnsigned pow(BigUnsigned base, BigUnsigned exponent)
+{
+    size_t top = exponent.bitLength();
+    if(top == 0)
+        return BigUnsigned(1);
+    size_t windowBits = getWindowBits(top);
+    vector<BigUnsigned> powers((size_t)1 << (windowBits - 1)); // base^1, base^3, base^5, ...
+    powers[0] = base;
+    if(powers.size() > 1)
+    {
+        BigUnsigned baseSquared = square(base);
+        for(size_t i = 1; i < powers.size(); i++)
+            powers[i] = powers[i - 1] * baseSquared;
+    }
+    size_t value;
+    top -= getWindow(exponent, top, windowBits, value);
+    BigUnsigned retval = powers[value / 2];
+    while(top > 0)
+    {
+        if(!exponent.testBit(top - 1))
+        {
+            retval = square(retval);
+            top--;
+            continue;
+        }
+        size_t length = getWindow(exponent, top, windowBits, value);
+        for(size_t i = 0; i < length; i++)
+            retval = square(retval);
+        retval *= powers[value / 2];
+        top -= length;
+    }
+    return retval;
+}
+
+/* Montgomery multiplication : with R = W^size for an odd modulus n of size words, numbers are kept as a * R mod n,
+ * and the product of a * R and b * R is brought back to a * b * R mod n by adding the multiple of n that clears the
+ * bottom word, one word at a time, and dropping that word, so no division is needed.  The product itself goes through
+ * multiplyWords(), whose vector kernels beat the word-interleaved (CIOS) form of the same loop.  The reduction stays
+ * quadratic, so past MontgomeryMaxWords words the subquadratic division in Divisor wins.
+ */
+
+static const size_t MontgomeryMaxWords = 128;
+
+static void montgomeryReduce(WordType dest[], WordType product[], const WordType modulus[], size_t size, WordType modulusInverse) // dest = product / W^size mod modulus; product holds 2 * size words, is below modulus * W^size and is overwritten; modulusInverse = -modulus^-1 mod W
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        // the word this clears keeps the carry out of the top, which is only added in at the end
+        product[i] = addmul_1(product + i, modulus, size, product[i] * modulusInverse);
+    }
+    // the result is below 2 * modulus
+    if(addWords(dest, product + size, size, product, size) || compareWords(dest, size, modulus, size) >= 0)
+        subtractWords(dest, dest, size, modulus, size);
+}
+
+static void montgomeryMultiply(WordType dest[], const WordType a[], const WordType b[], const WordType modulus[], size_t size, WordType modulusInverse, WordType product[]) // dest = a * b / W^size mod modulus; a and b must be below modulus and product holds 2 * size words; a == b squares
+{
+    multiplyWords(product, a, size, b, size);
+    montgomeryReduce(dest, product, modulus, size, modulusInverse);
+}
+
+template <typename Multiply>
+static void powWords(WordType dest[], const BigUnsigned & exponent, size_t size, const WordType one[], Multiply multiply) // dest = dest^exponent, with multiply(dest, a, b) for the modular product, which may write over a or b and squares for a == b; one is only read for a 0 exponent
+{
+    size_t top = exponent.bitLength();
+    if(top == 0)
+    {
+        copy(one, one + size, dest);
+        return;
+    }
+    size_t windowBits = getWindowBits(top), powerCount = (size_t)1 << (windowBits - 1);
+    vector<WordType> powers(powerCount * size); // dest^1, dest^3, dest^5, ...
+    copy(dest, dest + size, powers.begin());
+    if(powerCount > 1)
+    {
+        multiply(dest, dest, dest);
+        for(size_t i = 1; i < powerCount; i++)
+            multiply(&powers[i * size], &powers[(i - 1) * size], dest);
+    }
+    size_t value;
+    top -= getWindow(exponent, top, windowBits, value);
+    copy(powers.begin() + value / 2 * size, powers.begin() + (value / 2 + 1) * size, dest);
+    while(top > 0)
+    {
+        if(!exponent.testBit(top - 1))
+        {
+            multiply(dest, dest, dest);
+            top--;
+            continue;
+        }
+        size_t length = getWindow(exponent, top, windowBits, value);
+        for(size_t i = 0; i < length; i++)
+            multiply(dest, dest, dest);
+        multiply(dest, dest, &powers[value / 2 * size]);
+        top -= length;
+    }
+}
+
+BigUnsigned BigUnsigned::powModMontgomery(BigUnsigned base, BigUnsigned exponent, BigUnsigned modulus) // modulus must be odd and more than 1
+{
+    size_t size = modulus.data->size;
+    const WordType * modulusWords = modulus.data->words;
+    WordType modulusInverse = 0 - inverseModWord(modulusWords[0]);
+    if(!exponent)
+        return BigUnsigned(1);
+    // base * R is the only division
+    BigUnsigned montgomeryBase = (base << size * BitsPerWord) % modulus;
+    vector<WordType> x(size), one(size), product(2 * size);
+    copy(montgomeryBase.data->words, montgomeryBase.data->words + montgomeryBase.data->size, x.begin());
+    powWords(&x[0], exponent, size, &one[0], [&](WordType * dest, const WordType * a, const WordType * b)
+    {
+        montgomeryMultiply(dest, a, b, modulusWords, size, modulusInverse, &product[0]);
+    });
+    // multiplying by 1 takes the R back out
+    one[0] = 1;
+    montgomeryMultiply(&x[0], &x[0], &one[0], modulusWords, size, modulusInverse, &product[0]);
+    BigUnsigned retval(0, size);
+    for(size_t i = 0; i < size; i++)
+        retval.data->words[i] = x[i];
+    retval.normalize();
+    return retval;
+}
+
+ModContext::ModContext(BigUnsigned modulus)
+    : modulus(modulus), size(modulus.data->size), modulusInverse(0), specialForm(false), specialFormBits(0), one(size), rSquared(size), product(2 * size)
+{
+    if(modulus <= (WordType)1)
+        handleError("modulus must be more than 1 in ModContext::ModContext");
+    if(useSpecialForm(modulus, specialFormBits, specialFormTerm))
+    {
+        // values are kept as they are and products are folded
+        specialForm = true;
+        one[0] = 1;
+        product.resize(3 * (2 * size + specialFormTerm.data->size + 1));
+        return;
+    }
+    if((modulus.data->words[0] & 1) == 0)
+        handleError("modulus must be odd or 2^k - c for a short c in ModContext::ModContext");
+    modulusInverse = 0 - inverseModWord(modulus.data->words[0]);
+    BigUnsigned r = (BigUnsigned(1) << size * BitsPerWord) % modulus, r2 = (BigUnsigned(1) << 2 * size * BitsPerWord) % modulus;
+    copy(r.data->words, r.data->words + r.data->size, one.begin());
+    copy(r2.data->words, r2.data->words + r2.data->size, rSquared.begin());
+}
+
+ModContext::ModContext(const ModContext & rt)
+    : modulus(rt.modulus), size(rt.size), modulusInverse(rt.modulusInverse), specialForm(rt.specialForm), specialFormBits(rt.specialFormBits), specialFormTerm(rt.specialFormTerm), one(rt.one), rSquared(rt.rSquared), product(rt.product)
+{
+    // reference counts aren't atomic, so a copy that goes to another thread can't share numbers
+    modulus.onWrite();
+    specialFormTerm.onWrite();
+}
+
+const ModContext & ModContext::operator =(const ModContext & rt)
+{
+    if(this == &rt)
+        return *this;
+    modulus = rt.modulus;
+    size = rt.size;
+    modulusInverse = rt.modulusInverse;
+    specialForm = rt.specialForm;
+    specialFormBits = rt.specialFormBits;
+    specialFormTerm = rt.specialFormTerm;
+    one = rt.one;
+    rSquared = rt.rSquared;
+    product = rt.product;
+    modulus.onWrite();
+    specialFormTerm.onWrite();
+    return *this;
+}
+
+void ModContext::convertIn(WordType dest[], BigUnsigned v) const // dest gets size words
+{
+    if(v >= modulus)
+        v %= modulus;
+    fill(dest, dest + size, 0);
+    copy(v.data->words, v.data->words + v.data->size, dest);
+    if(!specialForm)
+        montgomeryMultiply(dest, dest, &rSquared[0], modulus.data->words, size, modulusInverse, &product[0]);
+}
+
+BigUnsigned ModContext::convertOut(const WordType v[]) const
+{
+    BigUnsigned retval(0, size);
+    WordType * words = retval.data->words;
+    if(specialForm)
+        copy(v, v + size, words);
+    else
+    {
+        // multiplying by 1 takes the R back out
+        copy(v, v + size, &product[0]);
+        fill(product.begin() + size, product.begin() + 2 * size, 0);
+        montgomeryReduce(words, &product[0], modulus.data->words, size, modulusInverse);
+    }
+    retval.normalize();
+    return retval;
+}
+
+void ModContext::add(WordType dest[], const WordType b[]) const // dest = dest + b mod modulus
+{
+    const WordType * modulusWords = modulus.data->words;
+    if(addWords(dest, dest, size, b, size) || compareWords(dest, size, modulusWords, size) >= 0)
+        subtractWords(dest, dest, size, modulusWords, size);
+}
+
+void ModContext::subtract(WordType dest[], const WordType b[]) const // dest = dest - b mod modulus
+{
+    if(subtractWords(dest, dest, size, b, size))
+        addWords(dest, dest, size, modulus.data->words, size);
+}
+
+void ModContext::negate(WordType dest[], const WordType a[]) const // dest = -a mod modulus
+{
+    size_t i = 0;
+    while(i < size && a[i] == 0)
+        i++;
+    if(i == size)
+        fill(dest, dest + size, 0);
+    else
+        subtractWords(dest, modulus.data->words, size, a, size);
+}
+
+void ModContext::multiply(WordType dest[], const WordType a[], const WordType b[]) const // a == b squares; dest may be a or b
+{
+    if(!specialForm)
+    {
+        montgomeryMultiply(dest, a, b, modulus.data->words, size, modulusInverse, &product[0]);
+        return;
+    }
+    size_t capacity = 2 * size + specialFormTerm.data->size + 1, termSize = !specialFormTerm ? 0 : specialFormTerm.data->size;
+    multiplyWords(&product[0], a, size, b, size);
+    reduceSpecialForm(dest, &product[0], 2 * size, specialFormBits, specialFormTerm.data->words, termSize, modulus.data->words, size, &product[capacity]);
+}
+
+void ModContext::power(WordType dest[], const BigUnsigned & exponent) const // dest = dest^exponent
+{
+    powWords(dest, exponent, size, &one[0], [this](WordType * productDest, const WordType * a, const WordType * b)
+    {
+        multiply(productDest, a, b);
+    });
+}
+
+ModInt::ModInt(const ModContext & context, BigUnsigned value)
+    : context(&context), words(context.size)
+{
+    context.convertIn(&words[0], value);
+}
+
+void ModInt::checkContext(const ModInt & b) const
+{
+    if(context != b.context)
+        handleError("ModInt values from different contexts");
+}
+
+const ModInt & ModInt::operator +=(const ModInt & b)
+{
+    checkContext(b);
+    context->add(&words[0], &b.words[0]);
+    return *this;
+}
+
+const ModInt & ModInt::operator -=(const ModInt & b)
+{
+    checkContext(b);
+    context->subtract(&words[0], &b.words[0]);
+    return *this;
+}
+
+const ModInt & ModInt::operator *=(const ModInt & b)
+{
+    checkContext(b);
+    context->multiply(&words[0], &words[0], &b.words[0]);
+    return *this;
+}
+
+ModInt ModInt::operator -() const
+{
+    ModInt retval(context);
+    context->negate(&retval.words[0], &words[0]);
+    return retval;
+}
+
+ModInt inverse(ModInt a)
+{
+    // extended Euclid on the plain value, keeping the coefficient of a reduced and unsigned
+    BigUnsigned modulus = a.getContext().getModulus();
+    BigUnsigned r0 = modulus, r1 = BigUnsigned(a), t0 = 0, t1 = 1;
+    while(!!r1)
+    {
+        BigUnsigned quotient, remainder;
+        BigUnsigned::divMod(r0, r1, quotient, remainder);
+        r0 = r1;
+        r1 = remainder;
+        BigUnsigned t = quotient * t1 % modulus;
+        t = t0 >= t ? t0 - t : t0 + (modulus - t);
+        t0 = t1;
+        t1 = t;
+    }
+    if(r0 != (WordType)1)
+        handleError("value has no inverse in inverse(ModInt)");
+    return ModInt(a.getContext(), t0);
+}
+
+static BigUnsigned reduce(BigUnsigned v, const Divisor & modulus)
+{
+    return v % modulus;
+}
+
+static BigUnsigned reduce(BigUnsigned v, const BarrettReducer & modulus)
+{
+    return modulus.reduce(v);
+}
+
+template <typename Reducer>
+static BigUnsigned powModReduced(BigUnsigned base, BigUnsigned exponent, const Reducer & modulus) // modulus is more than 1
+{
+    size_t top = exponent.bitLength();
+    if(top == 0)
+        return BigUnsigned(1);
+    size_t windowBits = getWindowBits(top);
+    vector<BigUnsigned> powers((size_t)1 << (windowBits - 1)); // base^1, base^3, base^5, ... mod modulus
+    powers[0] = reduce(base, modulus);
+    if(powers.size() > 1)
+    {
+        BigUnsigned baseSquared = reduce(square(powers[0]), modulus);
+        for(size_t i = 1; i < powers.size(); i++)
+            powers[i] = reduce(powers[i - 1] * baseSquared, modulus);
+    }
+    size_t value;
+    top -= getWindow(exponent, top, windowBits, value);
+    BigUnsigned retval = powers[value / 2];
+    while(top > 0)
+    {
+        if(!exponent.testBit(top - 1))
+        {
+            retval = reduce(square(retval), modulus);
+            top--;
+            continue;
+        }
+        size_t length = getWindow(exponent, top, windowBits, value);
+        for(size_t i = 0; i < length; i++)
+            retval = reduce(square(retval), modulus);
+        retval = reduce(retval * powers[value / 2], modulus);
+        top -= length;
+    }
+    return retval;
+}
+
+static bool useBarrettReduction(size_t modulusSize)
+{
+    // in between, schoolbook and Burnikel-Ziegler division do as well with one product as Barrett does with two
+    return (modulusSize >= BarrettMinWords && modulusSize <= BarrettMaxShortWords) || modulusSize >= BarrettMinLongWords;
+}
+
+BigUnsigned powMod(BigUnsigned base, BigUnsigned exponent, BigUnsigned modulus)
+{
+    if(modulus == (WordType)1)
+        return BigUnsigned(0);
+    size_t size = modulus.data->size;
+    size_t bits;
+    BigUnsigned term;
+    if(useSpecialForm(modulus, bits, term))
+    {
+        ModContext context(modulus);
+        return BigUnsigned(pow(ModInt(context, base), exponent));
+    }
+    if((modulus.data->words[0] & 1) != 0 && size <= MontgomeryMaxWords)
+        return BigUnsigned::powModMontgomery(base, exponent, modulus);
+    if(useBarrettReduction(size))
+        return powModReduced(base, exponent, BarrettReducer(modulus));
+    return powModReduced(base, exponent, Divisor(modulus));
+}
+
+FixedBasePowMod::FixedBasePowMod(BigUnsigned base, BigUnsigned modulus, size_t exponentBits, size_t tableBytes)
+    : context(modulus), base(base), exponentBits(max(exponentBits, (size_t)1)), rows(1), blocks(1), rowBits(this->exponentBits), blockBits(this->exponentBits)
+{
+    size_t size = context.size, entryBytes = size * BytesPerWord, bestCost = 2 * this->exponentBits;
+    // a comb of h rows and v blocks of b bits takes b - 1 squarings and up to v * b products, and keeps
+    // v * (2^h - 1) entries
+    for(size_t h = 2; h < BitsPerWord && h <= this->exponentBits && (((size_t)1 << h) - 1) * entryBytes <= tableBytes; h++)
+    {
+        size_t a = (this->exponentBits + h - 1) / h;
+        for(size_t v = 1; v <= a && v * (((size_t)1 << h) - 1) * entryBytes <= tableBytes; v++)
+        {
+            size_t b = (a + v - 1) / v;
+            if((a + b - 1) / b != v) // the same comb as a smaller v
+                continue;
+            size_t cost = b - 1 + v * b;
+            if(cost < bestCost)
+            {
+                bestCost = cost;
+                rows = h;
+                blocks = v;
+                rowBits = a;
+                blockBits = b;
+            }
+        }
+    }
+    size_t entriesPerBlock = ((size_t)1 << rows) - 1;
+    table.resize(blocks * entriesPerBlock * size);
+    // base^(2^(i * rowBits + j * blockBits)) for row i and block j, found in order by squaring
+    vector<WordType> power(size);
+    context.convertIn(&power[0], base);
+    for(size_t i = 0; i < rows; i++)
+    {
+        for(size_t j = 0; j < blocks; j++)
+        {
+            copy(power.begin(), power.end(), table.begin() + (j * entriesPerBlock + ((size_t)1 << i) - 1) * size);
+            if(i == rows - 1 && j == blocks - 1)
+                break;
+            size_t squarings = j < blocks - 1 ? blockBits : rowBits - j * blockBits;
+            for(size_t k = 0; k < squarings; k++)
+                context.multiply(&power[0], &power[0], &power[0]);
+        }
+    }
+    // every other set of rows from the set without its lowest row and that row
+    for(size_t j = 0; j < blocks; j++)
     {
-        dividend.data->expand(dividend.data->size + 2);
-        lshiftWords(dividend.data->words, dividend.data->words, dividend.data->size - 1, normalizationShift);
-        divisor.onWrite();
-        lshiftWords(divisor.data->words, divisor.data->words, divisor.data->size, normalizationShift);
+        WordType * entries = &table[j * entriesPerBlock * size];
+        for(size_t u = 3; u <= entriesPerBlock; u++)
+        {
+            size_t low = u & (u - 1);
+            if(low != 0)
+                context.multiply(entries + (u - 1) * size, entries + (low - 1) * size, entries + ((u ^ low) - 1) * size);
+        }
     }
-    else if(dividend.data->size == divisor.data->size)
+}
+
+BigUnsigned FixedBasePowMod::pow(BigUnsigned exponent) const
+{
+    if(exponent.bitLength() > exponentBits)
     {
-        dividend.data->expand(dividend.data->size + 2);
+        vector<WordType> words(context.size);
+        context.convertIn(&words[0], base);
+        context.power(&words[0], exponent);
+        return context.convertOut(&words[0]);
     }
-    else
+    size_t size = context.size, entriesPerBlock = ((size_t)1 << rows) - 1;
+    vector<WordType> retval(size);
+    bool started = false;
+    for(size_t k = blockBits; k-- > 0;)
     {
-        dividend.data->expand(dividend.data->size + 1);
+        if(started)
+            context.multiply(&retval[0], &retval[0], &retval[0]);
+        for(size_t j = blocks; j-- > 0;)
+        {
+            size_t bit = j * blockBits + k, u = 0;
+            if(bit >= rowBits)
+                continue;
+            for(size_t i = 0; i < rows; i++, bit += rowBits)
+            {
+                if(exponent.testBit(bit))
+                    u |= (size_t)1 << i;
+            }
+            if(u == 0)
+                continue;
+            const WordType * entry = &table[(j * entriesPerBlock + u - 1) * size];
+            if(started)
+                context.multiply(&retval[0], &retval[0], entry);
+            else
+                copy(entry, entry + size, retval.begin());
+            started = true;
+        }
     }
-    divide(dividend.data->words, dividend.data->size - 1, divisor.data->words, divisor.data->size);
-    size_t remainderSize = divisor.data->size;
-    size_t quotientSize = dividend.data->size - divisor.data->size;
-    if(premainder)
+    if(!started)
+        return BigUnsigned(1);
+    return context.convertOut(&retval[0]);
+}
+
+/* Simultaneous exponentiation (Straus) : every exponent gets its own sliding windows and table of odd powers of its
+ * base, as in powMod, but all the windows are multiplied into one product while the bits are scanned from the top,
+ * so a product of n powers takes the squarings of one exponentiation and the window multiplications of n.
+ */
+
+template <typename Value, typename Multiply>
+static Value multiPowWindowed(const vector<Value> & bases, const vector<BigUnsigned> & exponents, Value one, Multiply multiply) // the product of bases[i]^exponents[i], with multiply(a, b) setting a = a * b mod the modulus, which squares for a == b; one is 1 mod the modulus
+{
+    size_t count = bases.size(), top = 0;
+    vector<vector<Value>> powers(count); // base^1, base^3, base^5, ... for each base
+    vector<size_t> windowBits(count), positions(count), values(count); // positions[i] is how many bits of exponents[i] are left to scan
+    vector<bool> pending(count, false); // a window is scanned but not multiplied in yet
+    for(size_t i = 0; i < count; i++)
     {
-        BigUnsigned & remainder = *premainder;
-        remainder.onWrite();
-        remainder.data->resize(remainderSize);
-        rshiftWords(remainder.data->words, dividend.data->words, remainderSize, normalizationShift);
-        remainder.normalize();
+        positions[i] = exponents[i].bitLength();
+        top = max(top, positions[i]);
+        if(positions[i] == 0)
+            continue;
+        windowBits[i] = getWindowBits(positions[i]);
+        powers[i].assign((size_t)1 << (windowBits[i] - 1), bases[i]);
+        if(powers[i].size() > 1)
+        {
+            Value baseSquared = bases[i];
+            multiply(baseSquared, baseSquared);
+            for(size_t j = 1; j < powers[i].size(); j++)
+            {
+                powers[i][j] = powers[i][j - 1];
+                multiply(powers[i][j], baseSquared);
+            }
+        }
     }
-    if(pquotient)
+    Value retval = one;
+    bool started = false;
+    for(size_t bit = top; bit-- > 0;)
     {
-        BigUnsigned & quotient = *pquotient;
-        quotient.onWrite();
-        quotient.data->resize(quotientSize);
-        for(size_t i = 0; i < quotientSize; i++)
+        if(started)
+            multiply(retval, retval);
+        for(size_t i = 0; i < count; i++)
         {
-            quotient.data->words[i] = dividend.data->words[i + divisor.data->size];
+            if(!pending[i] && positions[i] == bit + 1)
+            {
+                if(!exponents[i].testBit(bit))
+                {
+                    positions[i]--;
+                    continue;
+                }
+                // the window goes in once the squarings get down to its bottom bit
+                positions[i] -= getWindow(exponents[i], positions[i], windowBits[i], values[i]);
+                pending[i] = true;
+            }
+            if(pending[i] && positions[i] == bit)
+            {
+                if(started)
+                    multiply(retval, powers[i][values[i] / 2]);
+                else
+                    retval = powers[i][values[i] / 2];
+                started = true;
+                pending[i] = false;
+            }
         }
     }
+    return retval;
 }
 
-void BigUnsigned::divMod(WordType dividend, BigUnsigned divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+template <typename Reducer>
+static BigUnsigned multiPowModReduced(const vector<BigUnsigned> & bases, const vector<BigUnsigned> & exponents, const Reducer & modulus)
 {
-    if(divisor.data->size == 1)
+    vector<BigUnsigned> reducedBases;
+    for(const BigUnsigned & base : bases)
+        reducedBases.push_back(reduce(base, modulus));
+    return multiPowWindowed(reducedBases, exponents, BigUnsigned(1), [&](BigUnsigned & a, const BigUnsigned & b)
     {
-        ::divMod(dividend, divisor.data->words[0], pquotient, premainder);
-        return;
+        a = reduce(a * b, modulus);
+    });
+}
+
+BigUnsigned multiPowMod(const vector<BigUnsigned> & bases, const vector<BigUnsigned> & exponents, BigUnsigned modulus)
+{
+    if(bases.size() != exponents.size())
+        handleError("different numbers of bases and exponents in multiPowMod");
+    if(modulus == (WordType)1)
+        return BigUnsigned(0);
+    size_t size = modulus.data->size;
+    size_t bits;
+    BigUnsigned term;
+    if(useSpecialForm(modulus, bits, term) || ((modulus.data->words[0] & 1) != 0 && size <= MontgomeryMaxWords))
+    {
+        ModContext context(modulus);
+        vector<ModInt> values;
+        for(const BigUnsigned & base : bases)
+            values.push_back(ModInt(context, base));
+        return BigUnsigned(multiPowWindowed(values, exponents, ModInt(context, 1), [](ModInt & a, const ModInt & b)
+        {
+            a *= b;
+        }));
     }
-    if(pquotient)
-        *pquotient = 0;
-    if(premainder)
-        *premainder = dividend;
+    if(useBarrettReduction(size))
+        return multiPowModReduced(bases, exponents, BarrettReducer(modulus));
+    return multiPowModReduced(bases, exponents, Divisor(modulus));
 }
 
-void BigUnsigned::divMod(BigUnsigned dividend, WordType divisor, BigUnsigned * pquotient, BigUnsigned * premainder)
+struct TaskQueue // a run of task indices, taken from the front by its own thread and from the back by others
 {
-    if(divisor == 0)
-        handleError("division by 0 in BigUnsigned::divMod");
-    if(divisor == 1)
+    mutex lock;
+    size_t begin, end;
+};
+
+static bool stealTasks(vector<TaskQueue> & queues, size_t worker) // moves the back half of the longest run left to the thread's queue; false when every run is done
+{
+    for(;;)
     {
-        if(premainder)
-            *premainder = 0;
-        if(pquotient)
-            *pquotient = dividend;
-        return;
+        size_t victim = worker, longest = 0;
+        for(size_t i = 0; i < queues.size(); i++)
+        {
+            lock_guard<mutex> guard(queues[i].lock);
+            if(queues[i].end - queues[i].begin > longest)
+            {
+                victim = i;
+                longest = queues[i].end - queues[i].begin;
+            }
+        }
+        if(longest == 0)
+            return false;
+        size_t begin, end;
+        {
+            lock_guard<mutex> guard(queues[victim].lock);
+            size_t length = queues[victim].end - queues[victim].begin;
+            if(length == 0) // its owner finished it in the meantime
+                continue;
+            end = queues[victim].end;
+            begin = end - (length + 1) / 2;
+            queues[victim].end = begin;
+        }
+        lock_guard<mutex> guard(queues[worker].lock);
+        queues[worker].begin = begin;
+        queues[worker].end = end;
+        return true;
     }
-    if(dividend.data->size == 1)
+}
+
+/* The threads batches of tasks run on : one for each core besides the calling thread, started on first use and kept
+ * for the rest of the process, so repeated batches don't pay for starting threads. Each worker has a queue, a run of
+ * task indices that starts as an equal share of the batch; a worker that is done with its run steals half of the
+ * longest run left, so the workers finish together even when the tasks or the cores aren't equally fast. The
+ * calling thread is worker 0, and batches from different threads take turns. A task mustn't start a batch itself.
+ */
+class TaskPool
+{
+    mutex batchLock; // held for a whole batch
+    mutex lock; // for everything below
+    condition_variable started, finished;
+    vector<thread> threads; // worker i + 1
+    vector<TaskQueue> queues;
+    vector<exception_ptr> errors;
+    const function<void(size_t, size_t)> * task;
+    size_t taskCount, workerCount, busyCount, batch;
+    atomic<bool> failed;
+    bool stopping;
+    TaskPool(size_t workers);
+    void stop();
+    void threadMain(size_t worker);
+    void work(size_t worker);
+public:
+    static size_t getMaxWorkerCount()
     {
-        ::divMod(dividend.data->words[0], divisor, pquotient, premainder);
-        return;
+        return max((size_t)1, (size_t)thread::hardware_concurrency());
     }
-    if(dividend.data->size == 2)
+    static TaskPool & get()
     {
-        WordType highWord = dividend.data->words[1];
-        if(highWord < divisor)
+        // never destroyed, so exiting doesn't have to wait for or stop the threads
+        static TaskPool * pool = new TaskPool(getMaxWorkerCount());
+        return *pool;
+    }
+    void run(size_t batchTaskCount, size_t batchWorkerCount, const function<void(size_t, size_t)> & batchTask); // task(worker, index) for every index below batchTaskCount on up to batchWorkerCount workers
+};
+
+TaskPool::TaskPool(size_t workers)
+    : queues(workers), errors(workers), task(nullptr), taskCount(0), workerCount(0), busyCount(0), batch(0), failed(false), stopping(false)
+{
+    for(TaskQueue & queue : queues)
+        queue.begin = queue.end = 0;
+    try
+    {
+        threads.reserve(workers - 1);
+        for(size_t i = 1; i < workers; i++)
+            threads.push_back(thread(&TaskPool::threadMain, this, i));
+    }
+    catch(const system_error &)
+    {
+        // fewer threads than cores
+    }
+    catch(...)
+    {
+        stop();
+        throw;
+    }
+}
+
+void TaskPool::stop()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    started.notify_all();
+    for(thread & t : threads)
+        t.join();
+    threads.clear();
+}
+
+void TaskPool::threadMain(size_t worker)
+{
+    size_t lastBatch = 0;
+    unique_lock<mutex> guard(lock);
+    for(;;)
+    {
+        started.wait(guard, [&]()
         {
-            WordType lowWord = dividend.data->words[0];
-            WordType quotient;
-            WordType remainder;
-            divideDoubleWord(highWord, lowWord, divisor, quotient, remainder);
-            if(pquotient)
-                *pquotient = quotient;
-            if(premainder)
-                *premainder = remainder;
+            return stopping || batch != lastBatch;
+        });
+        if(stopping)
             return;
+        lastBatch = batch;
+        if(worker >= workerCount)
+            continue;
+        guard.unlock();
+        work(worker);
+        guard.lock();
+        if(--busyCount == 0)
+            finished.notify_all();
+    }
+}
+
+void TaskPool::work(size_t worker)
+{
+    TaskQueue & queue = queues[worker];
+    try
+    {
+        while(!failed)
+        {
+            size_t index = taskCount;
+            {
+                lock_guard<mutex> guard(queue.lock);
+                if(queue.begin < queue.end)
+                    index = queue.begin++;
+            }
+            if(index < taskCount)
+                (*task)(worker, index);
+            else if(!stealTasks(queues, worker))
+                break;
         }
     }
-    if(!pquotient)
+    catch(...)
     {
-        WordType remainder = 0, quotient;
-        for(size_t i = 0, j = dividend.data->size - 1; i < dividend.data->size; i++, j--)
+        errors[worker] = current_exception();
+        failed = true;
+    }
+}
+
+void TaskPool::run(size_t batchTaskCount, size_t batchWorkerCount, const function<void(size_t, size_t)> & batchTask)
+{
+    lock_guard<mutex> batchGuard(batchLock);
+    {
+        lock_guard<mutex> guard(lock);
+        workerCount = max((size_t)1, min(batchWorkerCount, threads.size() + 1));
+        taskCount = batchTaskCount;
+        task = &batchTask;
+        for(size_t i = 0; i < queues.size(); i++)
         {
-            divideDoubleWord(remainder, dividend.data->words[j], divisor, quotient, remainder);
+            lock_guard<mutex> queueGuard(queues[i].lock);
+            queues[i].begin = i < workerCount ? taskCount * i / workerCount : 0;
+            queues[i].end = i < workerCount ? taskCount * (i + 1) / workerCount : 0;
+            errors[i] = nullptr;
         }
-        if(premainder)
-            *premainder = remainder;
+        failed = false;
+        busyCount = workerCount - 1;
+        batch++;
+    }
+    started.notify_all();
+    work(0);
+    unique_lock<mutex> guard(lock);
+    finished.wait(guard, [&]()
+    {
+        return busyCount == 0;
+    });
+    task = nullptr;
+    // the first exception a task throws stops the batch, and is rethrown once every worker is done
+    for(const exception_ptr & error : errors)
+    {
+        if(error)
+            rethrow_exception(error);
+    }
+}
+
+// calls task(worker, index) for every index below taskCount on up to threadCount workers, the calling thread being
+// worker 0; a single worker needs no pool
+template <typename Task>
+static void runTasks(size_t taskCount, size_t threadCount, Task task)
+{
+    if(threadCount <= 1)
+    {
+        for(size_t i = 0; i < taskCount; i++)
+            task(0, i);
         return;
     }
-    BigUnsigned & quotient = *pquotient;
-    quotient.onWrite();
-    quotient.data->expand(dividend.data->size);
-    WordType remainder = 0;
-    for(size_t i = 0, j = dividend.data->size - 1; i < dividend.data->size; i++, j--)
+    TaskPool::get().run(taskCount, threadCount, function<void(size_t, size_t)>(task));
+}
+
+vector<BigUnsigned> BigUnsigned::powModBatch(vector<BigUnsigned> bases, vector<BigUnsigned> exponents, BigUnsigned modulus, size_t threadCount)
+{
+    size_t taskCount = bases.size();
+    if(modulus == (WordType)1 || taskCount == 0)
+        return vector<BigUnsigned>(taskCount);
+    if(threadCount == 0)
+        threadCount = TaskPool::getMaxWorkerCount();
+    threadCount = max((size_t)1, min(min(threadCount, TaskPool::getMaxWorkerCount()), taskCount));
+    // reference counts aren't atomic, so no number one thread touches may share its data with a number another
+    // thread touches : every base and exponent gets data of its own, and every thread its own copy of the modulus
+    // work and of a shared exponent. The results are made on their threads and only moved into place
+    for(BigUnsigned & base : bases)
+        base.onWrite();
+    for(BigUnsigned & exponent : exponents)
+        exponent.onWrite();
+    vector<BigUnsigned> threadExponents;
+    if(exponents.size() == 1)
     {
-        divideDoubleWord(remainder, dividend.data->words[j], divisor, quotient.data->words[j], remainder);
+        threadExponents.assign(threadCount, exponents[0]);
+        for(BigUnsigned & exponent : threadExponents)
+            exponent.onWrite();
     }
-    if(premainder)
-        *premainder = remainder;
-    quotient.normalize();
+    auto getExponent = [&](size_t worker, size_t index) -> const BigUnsigned &
+    {
+        return exponents.size() == 1 ? threadExponents[worker] : exponents[index];
+    };
+    vector<BigUnsigned> results(taskCount);
+    size_t size = modulus.data->size;
+    size_t bits;
+    BigUnsigned term;
+    if(useSpecialForm(modulus, bits, term) || ((modulus.data->words[0] & 1) != 0 && size <= MontgomeryMaxWords))
+    {
+        // the precomputation is done once and copied
+        vector<ModContext> contexts(threadCount, ModContext(modulus));
+        runTasks(taskCount, threadCount, [&](size_t worker, size_t index)
+        {
+            results[index] = BigUnsigned(pow(ModInt(contexts[worker], move(bases[index])), getExponent(worker, index)));
+        });
+        return results;
+    }
+    // Divisor and BarrettReducer keep numbers that can't be copied apart, so each thread works its own out
+    vector<BigUnsigned> threadModuli(threadCount, modulus);
+    for(BigUnsigned & threadModulus : threadModuli)
+        threadModulus.onWrite();
+    if(useBarrettReduction(size))
+    {
+        vector<BarrettReducer> reducers;
+        for(const BigUnsigned & threadModulus : threadModuli)
+            reducers.push_back(BarrettReducer(threadModulus));
+        runTasks(taskCount, threadCount, [&](size_t worker, size_t index)
+        {
+            results[index] = powModReduced(move(bases[index]), getExponent(worker, index), reducers[worker]);
+        });
+        return results;
+    }
+    vector<Divisor> divisors;
+    for(const BigUnsigned & threadModulus : threadModuli)
+        divisors.push_back(Divisor(threadModulus));
+    runTasks(taskCount, threadCount, [&](size_t worker, size_t index)
+    {
+        results[index] = powModReduced(move(bases[index]), getExponent(worker, index), divisors[worker]);
+    });
+    return results;
+}
+
+RsaPrivateKey::RsaPrivateKey(BigUnsigned p, BigUnsigned q, BigUnsigned dP, BigUnsigned dQ, BigUnsigned qInv)
+    : p(p), q(q), dP(dP), dQ(dQ), qInv(qInv), modulus(p * q)
+{
+    if(p <= (WordType)1 || q <= (WordType)1 || p == q)
+        handleError("p and q must be different and more than 1 in RsaPrivateKey::RsaPrivateKey");
+}
+
+RsaPrivateKey RsaPrivateKey::fromPrimes(BigUnsigned p, BigUnsigned q, BigUnsigned decryptionExponent)
+{
+    if(p <= (WordType)1 || q <= (WordType)1 || p == q)
+        handleError("p and q must be different and more than 1 in RsaPrivateKey::fromPrimes");
+    ModContext pContext(p);
+    BigUnsigned qInv(inverse(ModInt(pContext, q)));
+    return RsaPrivateKey(p, q, decryptionExponent % (p - BigUnsigned(1)), decryptionExponent % (q - BigUnsigned(1)), qInv);
+}
+
+RsaPrivateKey RsaPrivateKey::fromExponents(BigUnsigned modulus, BigUnsigned encryptionExponent, BigUnsigned decryptionExponent)
+{
+    // e * d - 1 = 2^t * r is a multiple of lcm(p - 1, q - 1), so g^r has order 2^i mod p and 2^j mod q; unless
+    // i = j, squaring it reaches 1 mod one prime but not the other, and the value before is a square root of 1 that
+    // isn't +-1 and shares a factor with the modulus. That happens for at least half of all g
+    BigUnsigned k = encryptionExponent * decryptionExponent, r, one = BigUnsigned(1), modulusMinusOne = modulus - one;
+    if(modulus <= (WordType)3 || k <= one || !modulus.testBit(0))
+        handleError("modulus and exponents don't make an RSA key in RsaPrivateKey::fromExponents");
+    k -= one;
+    size_t t = 0;
+    for(r = k; !r.testBit(0); r >>= 1)
+        t++;
+    BigUnsigned p = 0;
+    for(WordType g = 2; g < 100 && !p; g++)
+    {
+        BigUnsigned y = powMod(BigUnsigned(g), r, modulus);
+        for(size_t i = 0; i < t && y != one && y != modulusMinusOne; i++)
+        {
+            BigUnsigned ySquared = y * y % modulus;
+            if(ySquared == one)
+            {
+                p = gcd(y - one, modulus);
+                break;
+            }
+            y = ySquared;
+        }
+    }
+    if(!p)
+        handleError("modulus and exponents don't make an RSA key in RsaPrivateKey::fromExponents");
+    return fromPrimes(p, modulus / p, decryptionExponent);
+}
+
+BigUnsigned RsaPrivateKey::decrypt(BigUnsigned c, bool useThreads) const
+{
+    if(c >= modulus)
+        c %= modulus;
+    BigUnsigned cQ = c % q, mP, mQ;
+    if(!useThreads)
+    {
+        mP = powMod(c % p, dP, p);
+        mQ = powMod(cQ, dQ, q);
+    }
+    else
+    {
+        // the thread gets numbers of its own, since reference counts aren't atomic
+        BigUnsigned threadQ = q, threadDQ = dQ;
+        threadQ.onWrite();
+        threadDQ.onWrite();
+        cQ.onWrite();
+        exception_ptr threadError;
+        thread worker([&]()
+        {
+            try
+            {
+                mQ = powMod(move(cQ), move(threadDQ), move(threadQ));
+            }
+            catch(...)
+            {
+                threadError = current_exception();
+            }
+        });
+        try
+        {
+            mP = powMod(c % p, dP, p);
+        }
+        catch(...)
+        {
+            worker.join();
+            throw;
+        }
+        worker.join();
+        if(threadError)
+            rethrow_exception(threadError);
+    }
+    // Garner : m = mQ + q * (qInv * (mP - mQ) mod p)
+    BigUnsigned mQModP = mQ % p;
+    BigUnsigned h = (mP >= mQModP ? mP - mQModP : mP + p - mQModP) * qInv % p;
+    return mQ + h * q;
 }
 
 const BigUnsigned & BigUnsigned::operator <<=(size_t shiftCount)
@@ -660,17 +3640,15 @@ const BigUnsigned & BigUnsigned::operator <<=(size_t shiftCount)
     shiftCount %= BitsPerWord;
     size_t shiftSize = data->size;
     size_t newSize = data->size + wordCount;
-    WordType topWord = data->words[data->size - 1] >> (BitsPerWord - shiftCount);
+    WordType topWord = 0;
+    if(shiftCount != 0)
+        topWord = data->words[data->size - 1] >> (BitsPerWord - shiftCount);
     if(topWord != 0)
         newSize++;
     data->expand(newSize);
     if(topWord != 0)
-        data->words[shiftSize] = topWord;
-    WordType * temp = new WordType[shiftSize];
-    for(size_t i = 0; i < shiftSize; i++)
-        temp[i] = data->words[i];
-    lshiftWords(data->words + wordCount, temp, shiftSize, shiftCount);
-    delete []temp;
+        data->words[shiftSize + wordCount] = topWord;
+    lshiftWords(data->words + wordCount, data->words, shiftSize, shiftCount);
     for(size_t i = 0; i < wordCount; i++)
     {
         data->words[i] = 0;
@@ -696,16 +3674,38 @@ const BigUnsigned & BigUnsigned::operator >>=(size_t shiftCount)
     }
     onWrite();
     size_t shiftSize = data->size - wordCount;
-    WordType * temp = new WordType[shiftSize];
-    for(size_t i = 0; i < shiftSize; i++)
-        temp[i] = data->words[i + wordCount];
-    rshiftWords(data->words, temp, shiftSize, shiftCount);
-    delete []temp;
+    rshiftWords(data->words, data->words + wordCount, shiftSize, shiftCount);
     data->size = shiftSize;
     normalize();
     return *this;
 }
 
+const BigUnsigned & BigUnsigned::operator ^=(BigUnsigned b)
+{
+    onWrite();
+    data->expand(b.data->size);
+    bitwiseWords(data->words, b.data->words, b.data->size, BitwiseXor);
+    normalize();
+    return *this;
+}
+
+const BigUnsigned & BigUnsigned::operator |=(BigUnsigned b)
+{
+    onWrite();
+    data->expand(b.data->size);
+    bitwiseWords(data->words, b.data->words, b.data->size, BitwiseOr);
+    return *this;
+}
+
+const BigUnsigned & BigUnsigned::operator &=(BigUnsigned b)
+{
+    onWrite();
+    data->size = min(data->size, b.data->size);
+    bitwiseWords(data->words, b.data->words, data->size, BitwiseAnd);
+    normalize();
+    return *this;
+}
+
 static WordType getCharacterValue(char ch)
 {
     if(isdigit(ch))
@@ -740,31 +3740,20 @@ BigUnsigned BigUnsigned::parse(string str, unsigned base)
     return retval;
 }
 
-string BigUnsigned::toString(unsigned base) const
+static void appendDigits(string & dest, BigUnsigned v, unsigned base, const Divisor & basePower, size_t digitCount, size_t width) // pads with zeros to width digits
 {
-    if(base < 2 || base > 36)
-        handleError("invalid base in BigUnsigned::toString");
-    WordType basePower = base;
-    size_t digitCount = 1;
-    while(basePower < WordMax / base)
-    {
-        basePower *= base;
-        digitCount++;
-    }
-    string retval;
-    retval.reserve((digitCount + 1) * data->size);
-    BigUnsigned v = *this;
+    string digits; // least significant first
     BigUnsigned remainder;
     WordType currentBlock;
-    while(v >= basePower)
+    while(v >= basePower.getValue())
     {
-        divMod(v, basePower, v, remainder);
+        BigUnsigned::divMod(v, basePower, v, remainder);
         currentBlock = (WordType)remainder;
         for(size_t i = 0; i < digitCount; i++)
         {
             WordType digit = currentBlock % base;
             currentBlock /= base;
-            retval.push_back(getCharacter(digit));
+            digits.push_back(getCharacter(digit));
         }
     }
     currentBlock = (WordType)v;
@@ -772,14 +3761,65 @@ string BigUnsigned::toString(unsigned base) const
     {
         WordType digit = currentBlock % base;
         currentBlock /= base;
-        retval.push_back(getCharacter(digit));
+        digits.push_back(getCharacter(digit));
     }
-    if(retval.size() >= 2)
+    if(digits.size() < width)
+        digits.append(width - digits.size(), '0');
+    dest.append(digits.rbegin(), digits.rend());
+}
+
+/* Subquadratic conversion: v < powers[level]^2 with powers[i] = basePower^(2^i), so dividing by powers[level]
+ * splits it into two halves that are converted separately, the low one padded to its full width.  With the
+ * recursive division this costs O(M(n) log n) instead of the O(n^2) of dividing off one word of digits at a time.
+ */
+static const size_t ToStringRecursiveThreshold = 30;
+
+static void appendDigitsRecursive(string & dest, BigUnsigned v, const vector<Divisor> & powers, size_t level, unsigned base, const Divisor & basePower, size_t digitCount, size_t width)
+{
+    if(((size_t)2 << level) < ToStringRecursiveThreshold)
     {
-        for(size_t i = 0, j = retval.size() - 1; j > i; j--, i++)
+        appendDigits(dest, v, base, basePower, digitCount, width);
+        return;
+    }
+    if(v < powers[level].getValue())
+    {
+        appendDigitsRecursive(dest, v, powers, level - 1, base, basePower, digitCount, width);
+        return;
+    }
+    BigUnsigned quotient, remainder;
+    BigUnsigned::divMod(v, powers[level], quotient, remainder);
+    size_t lowWidth = digitCount << level;
+    appendDigitsRecursive(dest, quotient, powers, level - 1, base, basePower, digitCount, width > lowWidth ? width - lowWidth : 0);
+    appendDigitsRecursive(dest, remainder, powers, level - 1, base, basePower, digitCount, lowWidth);
+}
+
+string BigUnsigned::toString(unsigned base) const
+{
+    if(base < 2 || base > 36)
+        handleError("invalid base in BigUnsigned::toString");
+    WordType basePower = base;
+    size_t digitCount = 1;
+    while(basePower < WordMax / base)
+    {
+        basePower *= base;
+        digitCount++;
+    }
+    string retval;
+    Divisor basePowerDivisor(basePower);
+    if(data->size < ToStringRecursiveThreshold)
+        appendDigits(retval, *this, base, basePowerDivisor, digitCount, 0);
+    else
+    {
+        vector<Divisor> powers(1, basePowerDivisor);
+        for(;;)
         {
-            std::swap(retval[i], retval[j]);
+            BigUnsigned nextPower = square(powers.back().getValue());
+            if(nextPower > *this)
+                break;
+            powers.push_back(Divisor(nextPower));
         }
+        retval.reserve((digitCount + 1) * data->size);
+        appendDigitsRecursive(retval, *this, powers, powers.size() - 1, base, basePowerDivisor, digitCount, 0);
     }
     if(retval == "")
         retval = "0";
@@ -8,15 +8,38 @@
 #include <cmath>
 #include <climits>
 #include <utility> // for swap
+#include <vector>
+#include <map>
+#include <type_traits> // for integral_constant
 
 using namespace std;
 
+// 64-bit words are used whenever the compiler has a 128-bit integer type; define BIGMATH_32BIT_WORDS to force 32-bit words
+#if !defined(BIGMATH_32BIT_WORDS) && defined(__SIZEOF_INT128__)
+#define BIGMATH_64BIT_WORDS
+#endif
+
+#ifdef BIGMATH_64BIT_WORDS
+typedef uint64_t WordType;
+__extension__ typedef unsigned __int128 DoubleWordType;
+#else
 typedef uint32_t WordType;
 typedef uint64_t DoubleWordType;
+#endif
 const WordType WordMax = ~(WordType)0;
 const size_t BytesPerWord = sizeof(WordType) / sizeof(uint8_t);
 const size_t BitsPerWord = BytesPerWord * 8;
 
+class Multiplier;
+class Divisor;
+class BarrettReducer;
+class SpecialFormReducer;
+class ModContext;
+class FixedBasePowMod;
+class RsaPrivateKey;
+template <size_t Bits>
+class FixedUnsigned;
+
 class BigUnsigned
 {
     struct Data
@@ -91,12 +114,16 @@ class BigUnsigned
             expand(newSize);
             size = newSize;
         }
+        enum : size_t {SharedRefCount = ~(size_t)0}; // for data that is never freed or written, whose count stays put
         void addRef()
         {
-            refCount++;
+            if(refCount != SharedRefCount)
+                refCount++;
         }
         void delRef()
         {
+            if(refCount == SharedRefCount)
+                return;
             refCount--;
             if(refCount == 0)
             {
@@ -130,22 +157,34 @@ class BigUnsigned
         return digit - 0xA + 'A';
     }
     enum {SmallNumberCount = 32};
-    static Data * smallNumbers;
+    static Data * smallNumbers; // shared by every thread, so their counts are never touched
+    static Data * makeSmallNumbers();
+    static BigUnsigned makeShared(BigUnsigned v) // gives v data of its own that is marked like the small numbers, for values kept for good
+    {
+        if(v.data->refCount != Data::SharedRefCount)
+        {
+            v.onWrite();
+            v.data->refCount = Data::SharedRefCount;
+        }
+        return v;
+    }
+    template <char... Chars>
+    friend BigUnsigned operator ""_bu();
+    template <size_t Bits>
+    friend class FixedUnsigned;
+    friend class Divisor;
+    friend class BarrettReducer;
+    friend class SpecialFormReducer;
+    friend class ModContext;
+    friend class RsaPrivateKey;
 public:
     BigUnsigned(WordType v = 0)
     {
         if(v < SmallNumberCount)
         {
             if(!smallNumbers)
-            {
-                smallNumbers = new Data[SmallNumberCount];
-                for(WordType i = 0; i < SmallNumberCount; i++)
-                {
-                    smallNumbers[i].words[0] = i;
-                }
-            }
+                smallNumbers = makeSmallNumbers();
             data = &smallNumbers[v];
-            data->addRef();
         }
         else
             data = new Data(v);
@@ -374,6 +413,8 @@ public:
         return operator *(b, a);
     }
     friend BigUnsigned operator *(BigUnsigned a, BigUnsigned b);
+    friend BigUnsigned operator *(BigUnsigned a, const Multiplier & b);
+    friend BigUnsigned square(BigUnsigned a);
     const BigUnsigned & operator *=(WordType b)
     {
         return operator =(operator *(*this, b));
@@ -382,6 +423,10 @@ public:
     {
         return operator =(operator *(*this, b));
     }
+    const BigUnsigned & operator *=(const Multiplier & b)
+    {
+        return operator =(operator *(*this, b));
+    }
     void swap(BigUnsigned & b)
     {
         Data * temp = data;
@@ -392,6 +437,14 @@ private:
     static void divMod(BigUnsigned dividend, BigUnsigned divisor, BigUnsigned * pquotient, BigUnsigned * premainder);
     static void divMod(WordType dividend, BigUnsigned divisor, BigUnsigned * pquotient, BigUnsigned * premainder);
     static void divMod(BigUnsigned dividend, WordType divisor, BigUnsigned * pquotient, BigUnsigned * premainder);
+    static void divMod(BigUnsigned dividend, const Divisor & divisor, BigUnsigned * pquotient, BigUnsigned * premainder);
+    static void divModNormalized(BigUnsigned dividend, BigUnsigned divisor, size_t normalizationShift, BigUnsigned * pquotient, BigUnsigned * premainder);
+    static void divModPreinverted(BigUnsigned dividend, WordType divisor, size_t normalizationShift, WordType reciprocal, BigUnsigned * pquotient, BigUnsigned * premainder);
+    static BigUnsigned reciprocal(BigUnsigned divisor, size_t bits);
+    static void divModNewton(BigUnsigned dividend, const Multiplier & divisor, const Multiplier & divisorReciprocal, BigUnsigned * pquotient, BigUnsigned * premainder);
+    static BigUnsigned productDifference(BigUnsigned a, BigUnsigned b, const Multiplier & c, size_t bits);
+    static BigUnsigned powModMontgomery(BigUnsigned base, BigUnsigned exponent, BigUnsigned modulus);
+    static vector<BigUnsigned> powModBatch(vector<BigUnsigned> bases, vector<BigUnsigned> exponents, BigUnsigned modulus, size_t threadCount); // exponents has one exponent for each base, or one for all of them
 public:
     static void divMod(BigUnsigned dividend, BigUnsigned divisor, BigUnsigned & quotient, BigUnsigned & remainder)
     {
@@ -405,6 +458,10 @@ public:
     {
         divMod(dividend, divisor, &quotient, &remainder);
     }
+    static void divMod(BigUnsigned dividend, const Divisor & divisor, BigUnsigned & quotient, BigUnsigned & remainder)
+    {
+        divMod(dividend, divisor, &quotient, &remainder);
+    }
     friend BigUnsigned operator /(BigUnsigned dividend, BigUnsigned divisor)
     {
         BigUnsigned retval;
@@ -423,6 +480,12 @@ public:
         divMod(dividend, divisor, &retval, NULL);
         return retval;
     }
+    friend BigUnsigned operator /(BigUnsigned dividend, const Divisor & divisor)
+    {
+        BigUnsigned retval;
+        divMod(dividend, divisor, &retval, NULL);
+        return retval;
+    }
     friend BigUnsigned operator %(BigUnsigned dividend, BigUnsigned divisor)
     {
         BigUnsigned retval;
@@ -441,6 +504,12 @@ public:
         divMod(dividend, divisor, NULL, &retval);
         return retval;
     }
+    friend BigUnsigned operator %(BigUnsigned dividend, const Divisor & divisor)
+    {
+        BigUnsigned retval;
+        divMod(dividend, divisor, NULL, &retval);
+        return retval;
+    }
     const BigUnsigned & operator /=(BigUnsigned b)
     {
         return operator =(operator /(*this, b));
@@ -449,6 +518,10 @@ public:
     {
         return operator =(operator /(*this, b));
     }
+    const BigUnsigned & operator /=(const Divisor & b)
+    {
+        return operator =(operator /(*this, b));
+    }
     const BigUnsigned & operator %=(BigUnsigned b)
     {
         return operator =(operator %(*this, b));
@@ -457,6 +530,10 @@ public:
     {
         return operator =(operator %(*this, b));
     }
+    const BigUnsigned & operator %=(const Divisor & b)
+    {
+        return operator =(operator %(*this, b));
+    }
     explicit operator WordType() const
     {
         return data->words[0];
@@ -469,17 +546,12 @@ public:
     {
         return data->size == 1 && data->words[0] == 0;
     }
-    const BigUnsigned & operator ^=(BigUnsigned b)
+    size_t bitLength() const; // 0 for 0
+    bool testBit(size_t bit) const
     {
-        onWrite();
-        data->expand(b.data->size);
-        for(size_t i = 0; i < b.data->size; i++)
-        {
-            data->words[i] ^= b.data->words[i];
-        }
-        normalize();
-        return *this;
+        return bit / BitsPerWord < data->size && (data->words[bit / BitsPerWord] >> (bit % BitsPerWord) & 1) != 0;
     }
+    const BigUnsigned & operator ^=(BigUnsigned b);
     const BigUnsigned & operator ^=(WordType b)
     {
         onWrite();
@@ -501,16 +573,7 @@ public:
         a ^= b;
         return a;
     }
-    const BigUnsigned & operator |=(BigUnsigned b)
-    {
-        onWrite();
-        data->expand(b.data->size);
-        for(size_t i = 0; i < b.data->size; i++)
-        {
-            data->words[i] |= b.data->words[i];
-        }
-        return *this;
-    }
+    const BigUnsigned & operator |=(BigUnsigned b);
     const BigUnsigned & operator |=(WordType b)
     {
         onWrite();
@@ -539,17 +602,7 @@ public:
         data->words[0] &= b;
         return *this;
     }
-    const BigUnsigned & operator &=(BigUnsigned b)
-    {
-        onWrite();
-        data->size = min(data->size, b.data->size);
-        for(size_t i = 0; i < data->size; i++)
-        {
-            data->words[i] &= b.data->words[i];
-        }
-        normalize();
-        return *this;
-    }
+    const BigUnsigned & operator &=(BigUnsigned b);
     friend BigUnsigned operator &(WordType a, BigUnsigned b)
     {
         b &= a;
@@ -577,65 +630,26 @@ public:
         v >>= shiftCount;
         return v;
     }
-    friend BigUnsigned pow(BigUnsigned base, BigUnsigned exponent)
+    friend BigUnsigned pow(BigUnsigned base, BigUnsigned exponent);
+    friend BigUnsigned powMod(BigUnsigned base, BigUnsigned exponent, BigUnsigned modulus);
+    friend BigUnsigned multiPowMod(const vector<BigUnsigned> & bases, const vector<BigUnsigned> & exponents, BigUnsigned modulus); // the product of bases[i]^exponents[i] mod modulus
+    // base^exponent mod modulus for each base, or for each (base, exponent) pair, in order, with the work spread over
+    // up to threadCount threads of a pool that has one for each core and is kept between calls, or all of them for 0
+    friend vector<BigUnsigned> batchPowMod(const vector<BigUnsigned> & bases, BigUnsigned exponent, BigUnsigned modulus, size_t threadCount = 0)
     {
-        BigUnsigned retval(1);
-        exponent.onWrite();
-        size_t exponentWordIndex = 0, exponentWordBitIndex = 0;
-        if((exponent.data->words[exponentWordIndex] & ((WordType)1 << exponentWordBitIndex)) != 0)
-        {
-            retval = base;
-            exponent.data->words[exponentWordIndex] &= ~((WordType)1 << exponentWordBitIndex);
-        }
-        exponentWordBitIndex++;
-        while(exponentWordIndex < exponent.data->size && exponent.data->words[exponent.data->size - 1] != 0)
-        {
-            base *= base;
-            if((exponent.data->words[exponentWordIndex] & ((WordType)1 << exponentWordBitIndex)) != 0)
-            {
-                exponent.data->words[exponentWordIndex] &= ~((WordType)1 << exponentWordBitIndex);
-                retval *= base;
-            }
-            if(++exponentWordBitIndex >= BitsPerWord)
-            {
-                exponentWordBitIndex = 0;
-                exponentWordIndex++;
-            }
-        }
-        return retval;
+        return powModBatch(bases, vector<BigUnsigned>(1, exponent), modulus, threadCount);
     }
-    friend BigUnsigned powMod(BigUnsigned base, BigUnsigned exponent, BigUnsigned modulus)
+    friend vector<BigUnsigned> batchPowMod(const vector<pair<BigUnsigned, BigUnsigned>> & tasks, BigUnsigned modulus, size_t threadCount = 0)
     {
-        if(modulus == (WordType)1)
-            return BigUnsigned(0);
-        base %= modulus;
-        BigUnsigned retval(1);
-        exponent.onWrite();
-        size_t exponentWordIndex = 0, exponentWordBitIndex = 0;
-        if((exponent.data->words[exponentWordIndex] & ((WordType)1 << exponentWordBitIndex)) != 0)
-        {
-            retval = base;
-            exponent.data->words[exponentWordIndex] &= ~((WordType)1 << exponentWordBitIndex);
-        }
-        exponentWordBitIndex++;
-        while(exponentWordIndex < exponent.data->size && exponent.data->words[exponent.data->size - 1] != 0)
+        vector<BigUnsigned> bases, exponents;
+        for(const pair<BigUnsigned, BigUnsigned> & task : tasks)
         {
-            base *= base;
-            base %= modulus;
-            if((exponent.data->words[exponentWordIndex] & ((WordType)1 << exponentWordBitIndex)) != 0)
-            {
-                exponent.data->words[exponentWordIndex] &= ~((WordType)1 << exponentWordBitIndex);
-                retval *= base;
-                retval %= modulus;
-            }
-            if(++exponentWordBitIndex >= BitsPerWord)
-            {
-                exponentWordBitIndex = 0;
-                exponentWordIndex++;
-            }
+            bases.push_back(task.first);
+            exponents.push_back(task.second);
         }
-        return retval;
+        return powModBatch(move(bases), move(exponents), modulus, threadCount);
     }
+    friend BigUnsigned exactDivide(BigUnsigned dividend, BigUnsigned divisor); // dividend / divisor when it is known to have no remainder; debug builds check that
     friend ostream & operator <<(ostream & os, BigUnsigned v)
     {
         unsigned base;
@@ -692,10 +706,245 @@ public:
     }
 };
 
-inline BigUnsigned operator ""_bu(const char * str)
+/* A multiplication operand that keeps its number-theoretic transform around, so repeated multiplications
+ * by the same large value only transform the other operand. Not safe to share between threads.
+ */
+class Multiplier
 {
-    return BigUnsigned::parse(str, true);
-}
+    BigUnsigned value;
+    mutable map<size_t, vector<WordType>> transforms; // indexed by transform length
+    friend class BigUnsigned;
+public:
+    explicit Multiplier(BigUnsigned value)
+        : value(value)
+    {
+    }
+    BigUnsigned getValue() const
+    {
+        return value;
+    }
+    friend BigUnsigned operator *(BigUnsigned a, const Multiplier & b);
+    friend BigUnsigned operator *(const Multiplier & a, BigUnsigned b)
+    {
+        return operator *(b, a);
+    }
+};
+
+/* A divisor with its normalization worked out once, for dividing many numbers by the same value. A one word
+ * divisor also gets its Möller-Granlund reciprocal, so dividing by it needs no hardware division; a very large one
+ * keeps its Newton reciprocal and the transforms after the first division that needs them. Not safe to share
+ * between threads.
+ */
+class Divisor
+{
+    BigUnsigned value, normalized; // normalized is value << normalizationShift, with its top bit set
+    size_t normalizationShift;
+    WordType reciprocal; // of the normalized word for a one word divisor
+    Multiplier valueMultiplier;
+    mutable Multiplier reciprocalMultiplier; // 0 until a Newton division needs it
+    friend class BigUnsigned;
+public:
+    explicit Divisor(BigUnsigned value);
+    BigUnsigned getValue() const
+    {
+        return value;
+    }
+};
+
+/* Barrett reduction : with mu = W^(2 * size) / m worked out once for a modulus m of size words, a number below
+ * W^(2 * size), such as the product of two reduced numbers, is reduced with two multiplications and at most two
+ * subtractions of m, for any modulus, odd or even. Not safe to share between threads.
+ */
+class BarrettReducer
+{
+    BigUnsigned modulus, reciprocal; // m and mu
+    size_t size;
+    Multiplier modulusMultiplier, reciprocalMultiplier; // for numbers long enough to use transforms
+    mutable vector<WordType> scratch;
+public:
+    explicit BarrettReducer(BigUnsigned modulus);
+    BigUnsigned getModulus() const
+    {
+        return modulus;
+    }
+    BigUnsigned reduce(BigUnsigned v) const; // v mod the modulus; bigger numbers than W^(2 * size) take a full division
+};
+
+/* Reduction modulo m = 2^bits - c for a c no longer than about half of m, as with Mersenne numbers, 2^255 - 19 or
+ * 2^448 - 2^224 - 1 : the bits above bit `bits` are multiplied by c and added back in, so reducing costs a product by
+ * c instead of a division. Not safe to share between threads.
+ */
+class SpecialFormReducer
+{
+    BigUnsigned modulus, term; // m and c
+    size_t bits, size;
+    mutable vector<WordType> scratch;
+public:
+    explicit SpecialFormReducer(BigUnsigned modulus); // finds bits and c, and throws when the modulus isn't of that form
+    SpecialFormReducer(size_t bits, BigUnsigned term); // for m = 2^bits - term; term must be below 2^(bits - 1), and reducing is slow unless it is well below that
+    static bool isSpecialForm(BigUnsigned modulus);
+    BigUnsigned getModulus() const
+    {
+        return modulus;
+    }
+    BigUnsigned reduce(BigUnsigned v) const; // v mod the modulus; bigger numbers than W^(2 * size) take a full division
+};
+
+class ModInt;
+
+/* An odd modulus with what Montgomery multiplication needs worked out once : -modulus^-1 mod W, R mod modulus and
+ * R^2 mod modulus for R = W^size. Values made from it are ModInts, which stay in Montgomery form, so chains of
+ * modular operations only convert on the way in and out. For a modulus of the form 2^k - c that SpecialFormReducer
+ * takes, when it is even or long enough for folding to beat Montgomery reduction, values stay as they are and
+ * products are folded instead. A ModContext has to outlive its ModInts. Not safe to share between threads, but a copy
+ * has numbers of its own, so copies can be used on different threads.
+ */
+class ModContext
+{
+    BigUnsigned modulus;
+    size_t size;
+    WordType modulusInverse;
+    bool specialForm;
+    size_t specialFormBits;
+    BigUnsigned specialFormTerm; // modulus = 2^specialFormBits - specialFormTerm when specialForm is set
+    vector<WordType> one, rSquared; // R and R^2 mod modulus
+    mutable vector<WordType> product; // and scratch for folding
+    void convertIn(WordType dest[], BigUnsigned v) const;
+    BigUnsigned convertOut(const WordType v[]) const;
+    void add(WordType dest[], const WordType b[]) const;
+    void subtract(WordType dest[], const WordType b[]) const;
+    void negate(WordType dest[], const WordType a[]) const;
+    void multiply(WordType dest[], const WordType a[], const WordType b[]) const;
+    void power(WordType dest[], const BigUnsigned & exponent) const;
+    friend class ModInt;
+    friend class FixedBasePowMod;
+public:
+    explicit ModContext(BigUnsigned modulus);
+    ModContext(const ModContext & rt);
+    const ModContext & operator =(const ModContext & rt);
+    BigUnsigned getModulus() const
+    {
+        return modulus;
+    }
+};
+
+/* A number modulo the modulus of a ModContext, kept in the form the context works in, in a buffer of the modulus
+ * size. The compound assignments work in that buffer, so they don't allocate.
+ */
+class ModInt
+{
+    const ModContext * context;
+    vector<WordType> words; // value * R mod modulus, or just value for a special form, context->size words
+    void checkContext(const ModInt & b) const;
+    ModInt(const ModContext * context)
+        : context(context), words(context->size)
+    {
+    }
+    void power(const BigUnsigned & exponent)
+    {
+        context->power(&words[0], exponent);
+    }
+public:
+    ModInt(const ModContext & context, BigUnsigned value);
+    const ModContext & getContext() const
+    {
+        return *context;
+    }
+    explicit operator BigUnsigned() const
+    {
+        return context->convertOut(&words[0]);
+    }
+    string toString(unsigned base = 10) const
+    {
+        return BigUnsigned(*this).toString(base);
+    }
+    friend ostream & operator <<(ostream & os, const ModInt & v)
+    {
+        return os << BigUnsigned(v);
+    }
+    friend bool operator ==(const ModInt & a, const ModInt & b)
+    {
+        return a.context == b.context && a.words == b.words;
+    }
+    friend bool operator !=(const ModInt & a, const ModInt & b)
+    {
+        return !operator ==(a, b);
+    }
+    const ModInt & operator +=(const ModInt & b);
+    const ModInt & operator -=(const ModInt & b);
+    const ModInt & operator *=(const ModInt & b);
+    ModInt operator -() const;
+    friend ModInt operator +(ModInt a, const ModInt & b)
+    {
+        return a += b;
+    }
+    friend ModInt operator -(ModInt a, const ModInt & b)
+    {
+        return a -= b;
+    }
+    friend ModInt operator *(ModInt a, const ModInt & b)
+    {
+        return a *= b;
+    }
+    friend ModInt square(ModInt a)
+    {
+        return a *= a;
+    }
+    friend ModInt inverse(ModInt a); // the value has to be coprime to the modulus
+    friend ModInt pow(ModInt base, BigUnsigned exponent)
+    {
+        base.power(exponent);
+        return base;
+    }
+};
+
+/* Powers of one base modulo one modulus, with a Lim-Lee comb worked out once : the exponent bits are laid out in
+ * rows, each row cut into blocks, and for every block and every set of rows the product of the base to the powers
+ * of 2 where those rows start is kept, so an exponentiation takes one squaring per bit of a block and one product
+ * per block instead of one squaring per exponent bit. The comb is the fastest one whose table fits in tableBytes.
+ * The modulus has to be one ModContext takes. Not safe to share between threads.
+ */
+class FixedBasePowMod
+{
+    ModContext context;
+    BigUnsigned base;
+    size_t exponentBits, rows, blocks, rowBits, blockBits;
+    vector<WordType> table; // for block j and rows u, at ((j << rows) - j + u - 1) * context.size, in the context's form
+public:
+    FixedBasePowMod(BigUnsigned base, BigUnsigned modulus, size_t exponentBits, size_t tableBytes = (size_t)1 << 20); // for exponents of up to exponentBits bits; longer ones take an ordinary exponentiation
+    BigUnsigned getBase() const
+    {
+        return base;
+    }
+    BigUnsigned getModulus() const
+    {
+        return context.getModulus();
+    }
+    BigUnsigned pow(BigUnsigned exponent) const; // base^exponent mod the modulus
+};
+
+/* An RSA private key in the Chinese remainder form of PKCS #1 : the primes p and q, dP = d mod (p - 1),
+ * dQ = d mod (q - 1) and qInv = q^-1 mod p. c^d mod pq comes from c^dP mod p and c^dQ mod q, two exponentiations
+ * with half the modulus and half the exponent, put back together with Garner's formula, which is about 4 times less
+ * work than the exponentiation mod pq. The two halves can run on two threads. Not safe to share between threads.
+ */
+class RsaPrivateKey
+{
+    BigUnsigned p, q, dP, dQ, qInv, modulus;
+public:
+    RsaPrivateKey(BigUnsigned p, BigUnsigned q, BigUnsigned dP, BigUnsigned dQ, BigUnsigned qInv);
+    static RsaPrivateKey fromPrimes(BigUnsigned p, BigUnsigned q, BigUnsigned decryptionExponent);
+    static RsaPrivateKey fromExponents(BigUnsigned modulus, BigUnsigned encryptionExponent, BigUnsigned decryptionExponent); // factors the modulus, which has to be the product of two primes
+    BigUnsigned getModulus() const
+    {
+        return modulus;
+    }
+    BigUnsigned decrypt(BigUnsigned c, bool useThreads = false) const; // c^d mod the modulus
+    BigUnsigned sign(BigUnsigned m, bool useThreads = false) const
+    {
+        return decrypt(m, useThreads);
+    }
+};
 
 namespace std
 {
@@ -706,6 +955,558 @@ inline void swap<BigUnsigned>(BigUnsigned & a, BigUnsigned & b)
 }
 }
 
+/* An unsigned integer of a fixed number of bits, stored inline so it never allocates. Arithmetic wraps modulo
+ * 2^Bits like the built-in unsigned types; powMod and division work on the full value. Everything is constexpr,
+ * so values can be computed at compile time.
+ */
+template <size_t Bits>
+class FixedUnsigned
+{
+    static_assert(Bits > 0, "FixedUnsigned needs at least one bit");
+public:
+    static constexpr size_t WordCount = (Bits + BitsPerWord - 1) / BitsPerWord;
+private:
+    static constexpr WordType TopWordMask = Bits % BitsPerWord == 0 ? WordMax : ((WordType)1 << Bits % BitsPerWord) - 1;
+    WordType words[WordCount];
+    constexpr void maskTopWord()
+    {
+        words[WordCount - 1] &= TopWordMask;
+    }
+    static constexpr size_t significantWords(const WordType * v, size_t size)
+    {
+        while(size > 1 && v[size - 1] == 0)
+            size--;
+        return size;
+    }
+    static constexpr void multiplyWords(WordType * dest, size_t destSize, const WordType * a, size_t aSize, const WordType * b, size_t bSize) // dest must be zeroed; keeps the low destSize words
+    {
+        for(size_t i = 0; i < bSize && i < destSize; i++)
+        {
+            WordType carry = 0;
+            size_t j = 0;
+            for(; j < aSize && i + j < destSize; j++)
+            {
+                DoubleWordType v = (DoubleWordType)a[j] * b[i] + dest[i + j] + carry;
+                dest[i + j] = (WordType)v;
+                carry = (WordType)(v >> BitsPerWord);
+            }
+            if(i + j < destSize)
+                dest[i + j] = carry;
+        }
+    }
+    /* Knuth's algorithm D. u has uSize words (at most 2 * WordCount), v has vSize significant words with
+     * vSize <= uSize; quotient gets uSize - vSize + 1 words and remainder gets vSize words.
+     */
+    static constexpr void divideWords(WordType * quotient, WordType * remainder, const WordType * u, size_t uSize, const WordType * v, size_t vSize)
+    {
+        if(vSize == 1)
+        {
+            WordType r = 0;
+            for(size_t j = uSize; j-- > 0;)
+            {
+                DoubleWordType n = (DoubleWordType)r << BitsPerWord | u[j];
+                quotient[j] = (WordType)(n / v[0]);
+                r = (WordType)(n % v[0]);
+            }
+            remainder[0] = r;
+            return;
+        }
+        WordType un[2 * WordCount + 1] = {}, vn[WordCount] = {};
+        size_t shift = 0;
+        while((v[vSize - 1] << shift) >> (BitsPerWord - 1) == 0)
+            shift++;
+        for(size_t i = vSize; i-- > 0;)
+            vn[i] = v[i] << shift | (shift != 0 && i > 0 ? v[i - 1] >> (BitsPerWord - shift) : 0);
+        un[uSize] = shift != 0 ? u[uSize - 1] >> (BitsPerWord - shift) : 0;
+        for(size_t i = uSize; i-- > 0;)
+            un[i] = u[i] << shift | (shift != 0 && i > 0 ? u[i - 1] >> (BitsPerWord - shift) : 0);
+        for(size_t j = uSize - vSize + 1; j-- > 0;)
+        {
+            DoubleWordType n = (DoubleWordType)un[j + vSize] << BitsPerWord | un[j + vSize - 1];
+            DoubleWordType qHat = n / vn[vSize - 1], rHat = n % vn[vSize - 1];
+            while(qHat >> BitsPerWord != 0 || qHat * vn[vSize - 2] > (rHat << BitsPerWord | un[j + vSize - 2]))
+            {
+                qHat--;
+                rHat += vn[vSize - 1];
+                if(rHat >> BitsPerWord != 0)
+                    break;
+            }
+            WordType carry = 0, borrow = 0;
+            for(size_t i = 0; i < vSize; i++)
+            {
+                DoubleWordType product = qHat * vn[i] + carry;
+                carry = (WordType)(product >> BitsPerWord);
+                WordType x = un[i + j], difference = x - (WordType)product;
+                WordType nextBorrow = x < (WordType)product;
+                un[i + j] = difference - borrow;
+                borrow = nextBorrow | (difference < borrow);
+            }
+            WordType top = un[j + vSize];
+            un[j + vSize] = top - carry - borrow;
+            quotient[j] = (WordType)qHat;
+            if(top < carry || top - carry < borrow) // qHat was one too big; add the divisor back
+            {
+                quotient[j]--;
+                carry = 0;
+                for(size_t i = 0; i < vSize; i++)
+                {
+                    DoubleWordType sum = (DoubleWordType)un[i + j] + vn[i] + carry;
+                    un[i + j] = (WordType)sum;
+                    carry = (WordType)(sum >> BitsPerWord);
+                }
+                un[j + vSize] += carry;
+            }
+        }
+        for(size_t i = 0; i < vSize; i++)
+            remainder[i] = un[i] >> shift | (shift != 0 ? un[i + 1] << (BitsPerWord - shift) : 0);
+    }
+    static constexpr FixedUnsigned multiplyMod(const FixedUnsigned & a, const FixedUnsigned & b, const FixedUnsigned & modulus, size_t modulusSize)
+    {
+        WordType product[2 * WordCount] = {}, quotient[2 * WordCount] = {};
+        multiplyWords(product, 2 * WordCount, a.words, WordCount, b.words, WordCount);
+        size_t productSize = significantWords(product, 2 * WordCount);
+        FixedUnsigned retval;
+        if(productSize < modulusSize)
+        {
+            for(size_t i = 0; i < productSize; i++)
+                retval.words[i] = product[i];
+        }
+        else
+            divideWords(quotient, retval.words, product, productSize, modulus.words, modulusSize);
+        return retval;
+    }
+    template <size_t LiteralBits>
+    friend constexpr FixedUnsigned<LiteralBits> parseFixedUnsignedLiteral(const char * str);
+public:
+    constexpr FixedUnsigned(WordType v = 0)
+        : words{}
+    {
+        words[0] = v;
+        maskTopWord();
+    }
+    explicit FixedUnsigned(const BigUnsigned & v) // keeps the low Bits bits
+        : words{}
+    {
+        for(size_t i = 0; i < WordCount && i < v.data->size; i++)
+            words[i] = v.data->words[i];
+        maskTopWord();
+    }
+    explicit operator BigUnsigned() const
+    {
+        size_t size = significantWords(words, WordCount);
+        BigUnsigned retval(words[0], size);
+        for(size_t i = 1; i < size; i++)
+            retval.data->words[i] = words[i];
+        return retval;
+    }
+    explicit constexpr operator WordType() const
+    {
+        return words[0];
+    }
+    explicit constexpr operator bool() const
+    {
+        return !operator !();
+    }
+    constexpr bool operator !() const
+    {
+        for(size_t i = 0; i < WordCount; i++)
+        {
+            if(words[i] != 0)
+                return false;
+        }
+        return true;
+    }
+    constexpr WordType getWord(size_t index) const
+    {
+        return index < WordCount ? words[index] : 0;
+    }
+    string toString(unsigned base = 10) const
+    {
+        return BigUnsigned(*this).toString(base);
+    }
+    friend ostream & operator <<(ostream & os, const FixedUnsigned & v)
+    {
+        return os << BigUnsigned(v);
+    }
+    friend constexpr int compare(const FixedUnsigned & a, const FixedUnsigned & b)
+    {
+        for(size_t i = WordCount; i-- > 0;)
+        {
+            if(a.words[i] != b.words[i])
+                return a.words[i] > b.words[i] ? 1 : -1;
+        }
+        return 0;
+    }
+    friend constexpr bool operator ==(const FixedUnsigned & a, const FixedUnsigned & b)
+    {
+        return compare(a, b) == 0;
+    }
+    friend constexpr bool operator !=(const FixedUnsigned & a, const FixedUnsigned & b)
+    {
+        return compare(a, b) != 0;
+    }
+    friend constexpr bool operator <(const FixedUnsigned & a, const FixedUnsigned & b)
+    {
+        return compare(a, b) < 0;
+    }
+    friend constexpr bool operator >(const FixedUnsigned & a, const FixedUnsigned & b)
+    {
+        return compare(a, b) > 0;
+    }
+    friend constexpr bool operator <=(const FixedUnsigned & a, const FixedUnsigned & b)
+    {
+        return compare(a, b) <= 0;
+    }
+    friend constexpr bool operator >=(const FixedUnsigned & a, const FixedUnsigned & b)
+    {
+        return compare(a, b) >= 0;
+    }
+    constexpr const FixedUnsigned & operator +=(const FixedUnsigned & b)
+    {
+        WordType carry = 0;
+        for(size_t i = 0; i < WordCount; i++)
+        {
+            DoubleWordType sum = (DoubleWordType)words[i] + b.words[i] + carry;
+            words[i] = (WordType)sum;
+            carry = (WordType)(sum >> BitsPerWord);
+        }
+        maskTopWord();
+        return *this;
+    }
+    constexpr const FixedUnsigned & operator -=(const FixedUnsigned & b)
+    {
+        WordType borrow = 0;
+        for(size_t i = 0; i < WordCount; i++)
+        {
+            WordType x = words[i], difference = x - b.words[i];
+            WordType nextBorrow = x < b.words[i];
+            words[i] = difference - borrow;
+            borrow = nextBorrow | (difference < borrow);
+        }
+        maskTopWord();
+        return *this;
+    }
+    constexpr const FixedUnsigned & operator *=(const FixedUnsigned & b)
+    {
+        FixedUnsigned product;
+        multiplyWords(product.words, WordCount, words, WordCount, b.words, significantWords(b.words, WordCount));
+        product.maskTopWord();
+        return operator =(product);
+    }
+    static constexpr void divMod(const FixedUnsigned & dividend, const FixedUnsigned & divisor, FixedUnsigned & quotient, FixedUnsigned & remainder)
+    {
+        if(!divisor)
+            throw runtime_error("division by zero");
+        size_t uSize = significantWords(dividend.words, WordCount), vSize = significantWords(divisor.words, WordCount);
+        FixedUnsigned q, r;
+        if(uSize < vSize || (uSize == vSize && dividend < divisor))
+            r = dividend;
+        else
+            divideWords(q.words, r.words, dividend.words, uSize, divisor.words, vSize);
+        quotient = q;
+        remainder = r;
+    }
+    constexpr const FixedUnsigned & operator /=(const FixedUnsigned & b)
+    {
+        FixedUnsigned remainder;
+        divMod(*this, b, *this, remainder);
+        return *this;
+    }
+    constexpr const FixedUnsigned & operator %=(const FixedUnsigned & b)
+    {
+        FixedUnsigned quotient;
+        divMod(*this, b, quotient, *this);
+        return *this;
+    }
+    constexpr const FixedUnsigned & operator <<=(size_t shiftCount)
+    {
+        size_t shiftSize = shiftCount / BitsPerWord;
+        shiftCount %= BitsPerWord;
+        for(size_t i = WordCount; i-- > 0;)
+        {
+            WordType v = 0;
+            if(i >= shiftSize)
+            {
+                v = words[i - shiftSize] << shiftCount;
+                if(shiftCount != 0 && i > shiftSize)
+                    v |= words[i - shiftSize - 1] >> (BitsPerWord - shiftCount);
+            }
+            words[i] = v;
+        }
+        maskTopWord();
+        return *this;
+    }
+    constexpr const FixedUnsigned & operator >>=(size_t shiftCount)
+    {
+        size_t shiftSize = shiftCount / BitsPerWord;
+        shiftCount %= BitsPerWord;
+        for(size_t i = 0; i < WordCount; i++)
+        {
+            WordType v = 0;
+            if(shiftSize < WordCount - i)
+            {
+                v = words[i + shiftSize] >> shiftCount;
+                if(shiftCount != 0 && shiftSize < WordCount - i - 1)
+                    v |= words[i + shiftSize + 1] << (BitsPerWord - shiftCount);
+            }
+            words[i] = v;
+        }
+        return *this;
+    }
+    constexpr const FixedUnsigned & operator ^=(const FixedUnsigned & b)
+    {
+        for(size_t i = 0; i < WordCount; i++)
+            words[i] ^= b.words[i];
+        return *this;
+    }
+    constexpr const FixedUnsigned & operator |=(const FixedUnsigned & b)
+    {
+        for(size_t i = 0; i < WordCount; i++)
+            words[i] |= b.words[i];
+        return *this;
+    }
+    constexpr const FixedUnsigned & operator &=(const FixedUnsigned & b)
+    {
+        for(size_t i = 0; i < WordCount; i++)
+            words[i] &= b.words[i];
+        return *this;
+    }
+    friend constexpr FixedUnsigned operator +(FixedUnsigned a, const FixedUnsigned & b)
+    {
+        return a += b;
+    }
+    friend constexpr FixedUnsigned operator -(FixedUnsigned a, const FixedUnsigned & b)
+    {
+        return a -= b;
+    }
+    friend constexpr FixedUnsigned operator *(FixedUnsigned a, const FixedUnsigned & b)
+    {
+        return a *= b;
+    }
+    friend constexpr FixedUnsigned operator /(FixedUnsigned a, const FixedUnsigned & b)
+    {
+        return a /= b;
+    }
+    friend constexpr FixedUnsigned operator %(FixedUnsigned a, const FixedUnsigned & b)
+    {
+        return a %= b;
+    }
+    friend constexpr FixedUnsigned operator <<(FixedUnsigned v, size_t shiftCount)
+    {
+        return v <<= shiftCount;
+    }
+    friend constexpr FixedUnsigned operator >>(FixedUnsigned v, size_t shiftCount)
+    {
+        return v >>= shiftCount;
+    }
+    friend constexpr FixedUnsigned operator ^(FixedUnsigned a, const FixedUnsigned & b)
+    {
+        return a ^= b;
+    }
+    friend constexpr FixedUnsigned operator |(FixedUnsigned a, const FixedUnsigned & b)
+    {
+        return a |= b;
+    }
+    friend constexpr FixedUnsigned operator &(FixedUnsigned a, const FixedUnsigned & b)
+    {
+        return a &= b;
+    }
+    friend constexpr FixedUnsigned powMod(FixedUnsigned base, const FixedUnsigned & exponent, const FixedUnsigned & modulus)
+    {
+        size_t modulusSize = significantWords(modulus.words, WordCount);
+        if(modulusSize == 1 && modulus.words[0] <= 1)
+        {
+            if(modulus.words[0] == 0)
+                throw runtime_error("division by zero");
+            return FixedUnsigned(0);
+        }
+        base %= modulus;
+        FixedUnsigned retval(1);
+        size_t i = Bits;
+        while(i > 0 && (exponent.words[(i - 1) / BitsPerWord] >> (i - 1) % BitsPerWord & 1) == 0)
+            i--;
+        while(i-- > 0)
+        {
+            retval = multiplyMod(retval, retval, modulus, modulusSize);
+            if((exponent.words[i / BitsPerWord] >> i % BitsPerWord & 1) != 0)
+                retval = multiplyMod(retval, base, modulus, modulusSize);
+        }
+        return retval;
+    }
+    friend constexpr FixedUnsigned gcd(FixedUnsigned a, FixedUnsigned b)
+    {
+        if(!a || !b)
+            return FixedUnsigned(0);
+        while(!!b)
+        {
+            FixedUnsigned c = a % b;
+            a = b;
+            b = c;
+        }
+        return a;
+    }
+    constexpr const FixedUnsigned & operator ++()
+    {
+        return *this += 1;
+    }
+    constexpr FixedUnsigned operator ++(int)
+    {
+        FixedUnsigned retval = *this;
+        *this += 1;
+        return retval;
+    }
+    constexpr const FixedUnsigned & operator --()
+    {
+        return *this -= 1;
+    }
+    constexpr FixedUnsigned operator --(int)
+    {
+        FixedUnsigned retval = *this;
+        *this -= 1;
+        return retval;
+    }
+};
+
+constexpr unsigned getLiteralDigit(char c) // 36 for anything that isn't a digit
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 0xA;
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 0xA;
+    return 36;
+}
+
+/* Parses an integer literal at compile time. Accepts the same forms as C++ integer literals: decimal, 0x hex,
+ * 0b binary and leading-0 octal, with ' digit separators. Digits in a power of 2 base are put straight into their
+ * bits; decimal digits are gathered a word's worth at a time, so each word's worth costs one product by a power of
+ * 10 over the words in use so far.
+ */
+template <size_t Bits>
+constexpr FixedUnsigned<Bits> parseFixedUnsignedLiteral(const char * str)
+{
+    const size_t WordCount = FixedUnsigned<Bits>::WordCount;
+    const size_t DecimalDigitsPerWord = BitsPerWord == 64 ? 19 : 9; // the most with 10^digits below W
+    unsigned base = 10, digitBits = 0;
+    if(str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+    {
+        base = 0x10;
+        digitBits = 4;
+        str += 2;
+    }
+    else if(str[0] == '0' && (str[1] == 'b' || str[1] == 'B'))
+    {
+        base = 2;
+        digitBits = 1;
+        str += 2;
+    }
+    else if(str[0] == '0')
+    {
+        base = 010;
+        digitBits = 3;
+        str++;
+    }
+    FixedUnsigned<Bits> retval;
+    if(digitBits != 0)
+    {
+        const char * end = str;
+        while(*end != '\0')
+            end++;
+        size_t bit = 0;
+        while(end != str)
+        {
+            char c = *--end;
+            if(c == '\'')
+                continue;
+            WordType digit = getLiteralDigit(c);
+            if(digit >= base)
+                throw runtime_error("invalid character in integer literal");
+            size_t index = bit / BitsPerWord, shift = bit % BitsPerWord;
+            if(index < WordCount)
+                retval.words[index] |= digit << shift;
+            if(shift + digitBits > BitsPerWord && index + 1 < WordCount)
+                retval.words[index + 1] |= digit >> (BitsPerWord - shift);
+            bit += digitBits;
+        }
+        retval.maskTopWord();
+        return retval;
+    }
+    size_t size = 1; // words in use
+    WordType chunk = 0, chunkScale = 1;
+    size_t chunkDigits = 0;
+    for(;; str++)
+    {
+        if(*str == '\'')
+            continue;
+        if(*str != '\0')
+        {
+            WordType digit = getLiteralDigit(*str);
+            if(digit >= base)
+                throw runtime_error("invalid character in integer literal");
+            chunk = chunk * 10 + digit;
+            chunkScale *= 10;
+            if(++chunkDigits < DecimalDigitsPerWord)
+                continue;
+        }
+        else if(chunkDigits == 0)
+            break;
+        // retval = retval * chunkScale + chunk
+        WordType carry = chunk;
+        for(size_t i = 0; i < size; i++)
+        {
+            DoubleWordType v = (DoubleWordType)retval.words[i] * chunkScale + carry;
+            retval.words[i] = (WordType)v;
+            carry = (WordType)(v >> BitsPerWord);
+        }
+        if(carry != 0 && size < WordCount)
+            retval.words[size++] = carry;
+        chunk = 0;
+        chunkScale = 1;
+        chunkDigits = 0;
+        if(*str == '\0')
+            break;
+    }
+    retval.maskTopWord();
+    return retval;
+}
+
+enum : size_t {MaxCompileTimeLiteralLength = 1024}; // longer literals are parsed on their first evaluation instead
+
+template <char... Chars>
+inline BigUnsigned makeBigUnsignedLiteral(true_type)
+{
+    constexpr char str[] = {Chars..., '\0'};
+    constexpr FixedUnsigned<4 * sizeof...(Chars)> words = parseFixedUnsignedLiteral<4 * sizeof...(Chars)>(str);
+    return BigUnsigned(words);
+}
+
+template <char... Chars>
+inline BigUnsigned makeBigUnsignedLiteral(false_type)
+{
+    const char chars[] = {Chars..., '\0'};
+    string str;
+    for(const char * c = chars; *c != '\0'; c++)
+    {
+        if(*c != '\'')
+            str += *c;
+    }
+    if(str.substr(0, 2) == "0b" || str.substr(0, 2) == "0B")
+        return BigUnsigned::parse(str.substr(2), 2U);
+    return BigUnsigned::parse(str, true);
+}
+
+/* Literals up to MaxCompileTimeLiteralLength characters are parsed while compiling, and longer ones on the first
+ * evaluation; either way, the first evaluation builds the BigUnsigned, and after that every evaluation just shares
+ * its data, which is never freed and whose count is never touched, so evaluating it on several threads is safe.
+ */
+template <char... Chars>
+inline BigUnsigned operator ""_bu()
+{
+    static const BigUnsigned value = BigUnsigned::makeShared(makeBigUnsignedLiteral<Chars...>(integral_constant<bool, sizeof...(Chars) <= MaxCompileTimeLiteralLength>()));
+    return value;
+}
+
 class BigInteger
 {
     BigUnsigned value;
@@ -725,6 +1526,12 @@ public:
         : value(value), negative(false)
     {
     }
+#ifdef BIGMATH_64BIT_WORDS
+    BigInteger(unsigned value)
+        : value((WordType)value), negative(false)
+    {
+    }
+#endif
     BigInteger(int value)
         : value((WordType)abs(value)), negative(value < 0)
     {
@@ -823,6 +1630,10 @@ public:
     {
         return BigInteger(a.value / b.value, a.negative ? !b.negative : b.negative);
     }
+    friend BigInteger exactDivide(BigInteger a, BigInteger b)
+    {
+        return BigInteger(exactDivide(a.value, b.value), a.negative ? !b.negative : b.negative);
+    }
     const BigInteger & operator /=(BigInteger b)
     {
         negative = (negative ? !b.negative : b.negative);
@@ -904,6 +1715,23 @@ public:
             throw runtime_error("exponent is less than zero in powMod(BigInteger, BigInteger, BigInteger)");
         return BigInteger(powMod(base.value, exponent.value, modulus.value), base.negative && (exponent.value & (WordType)1) != 0);
     }
+    friend BigInteger multiPowMod(const vector<BigInteger> & bases, const vector<BigInteger> & exponents, BigInteger modulus)
+    {
+        if(bases.size() != exponents.size())
+            throw runtime_error("different numbers of bases and exponents in multiPowMod(vector<BigInteger>, vector<BigInteger>, BigInteger)");
+        vector<BigUnsigned> baseValues, exponentValues;
+        bool negative = false;
+        for(size_t i = 0; i < bases.size(); i++)
+        {
+            if(exponents[i] < 0)
+                throw runtime_error("exponent is less than zero in multiPowMod(vector<BigInteger>, vector<BigInteger>, BigInteger)");
+            baseValues.push_back(bases[i].value);
+            exponentValues.push_back(exponents[i].value);
+            if(bases[i].negative && (exponents[i].value & (WordType)1) != 0)
+                negative = !negative;
+        }
+        return BigInteger(multiPowMod(baseValues, exponentValues, modulus.value), negative);
+    }
     friend BigInteger gcd(BigInteger a, BigInteger b)
     {
         return BigInteger(gcd(a.value, b.value), false);
@@ -930,9 +1758,11 @@ public:
     }
 };
 
-inline BigInteger operator ""_bi(const char * str)
+template <char... Chars>
+inline BigInteger operator ""_bi()
 {
-    return BigInteger::parse(str, true);
+    static const BigInteger value(operator ""_bu<Chars...>());
+    return value;
 }
 
 #endif